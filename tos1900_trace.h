@@ -0,0 +1,80 @@
+/* *********************** BEGIN LICENSE BLOCK *******************************\
+ *
+ * tos1900_trace.h - Tracepoints for the Toshiba TOS1900 ACPI device.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+\* *********************** END LICENSE BLOCK *********************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tos1900
+
+#if !defined(_TOS1900_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TOS1900_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** One evaluation of the SPFC method (result is out[0]). */
+TRACE_EVENT(tos1900_spfc_call,
+
+    TP_PROTO(u32 op, u32 reg, u32 status, u32 result, u64 duration_ns),
+
+    TP_ARGS(op, reg, status, result, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(u32, op)
+        __field(u32, reg)
+        __field(u32, status)
+        __field(u32, result)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->op = op;
+        __entry->reg = reg;
+        __entry->status = status;
+        __entry->result = result;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("op=0x%04x reg=0x%04x status=0x%x result=0x%04x duration=%llu ns",
+              __entry->op, __entry->reg, __entry->status, __entry->result,
+              (unsigned long long)__entry->duration_ns)
+);
+
+/** One evaluation of the PIDC device query. */
+TRACE_EVENT(tos1900_pidc_call,
+
+    TP_PROTO(u32 id, u32 status, u32 result, u64 duration_ns),
+
+    TP_ARGS(id, status, result, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(u32, id)
+        __field(u32, status)
+        __field(u32, result)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->id = id;
+        __entry->status = status;
+        __entry->result = result;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("id=0x%02x status=0x%x result=0x%x duration=%llu ns",
+              __entry->id, __entry->status, __entry->result,
+              (unsigned long long)__entry->duration_ns)
+);
+
+#endif /* _TOS1900_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tos1900_trace
+#include <trace/define_trace.h>
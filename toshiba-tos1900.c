@@ -34,8 +34,22 @@
 #include <linux/input.h>
 #include <linux/input/sparse-keymap.h>
 #include <linux/platform_device.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/completion.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/workqueue.h>
+#include <linux/platform_profile.h>
 #include <acpi/acpi_drivers.h>
 
+#define CREATE_TRACE_POINTS
+#include "tos1900_trace.h"
+
 MODULE_ALIAS("platform:toshiba-tos1900");
 MODULE_DESCRIPTION("Driver for the Toshiba Laptop TOS1900 Device");
 MODULE_AUTHOR("Isaac Lenton (aka ilent2) <isaac@isuniversal.com>");
@@ -61,6 +75,8 @@ MODULE_VERSION(TOSHIBA_TOS1900_VERSION);
 #define SPFC_UPPER_SET          0xF400
 #define SPFC_UPPER_GET          0xF300
 
+#define SPFC_SUCCESS            0x0000
+#define SPFC_FAILURE            0x1000
 #define SPFC_NOT_SUPPORTED      0x8000
 
 #define SPFC_ILLUMINATION       0x014E
@@ -77,6 +93,20 @@ MODULE_VERSION(TOSHIBA_TOS1900_VERSION);
 #define SPFC_HOTKEY_ENABLE      0x08
 #define SPFC_HOTKEY_DISABLE     0x0A
 
+/* Registers with their own debugfs statistics slot, followed by one slot
+ * for PIDC queries and one for any other SPFC register. */
+static const u32 tos1900_stat_regs[] = {
+    SPFC_ILLUMINATION, SPFC_KBD_BACKLIGHT, SPFC_BOOT_SPEED, SPFC_SLEEP_MUSIC,
+    SPFC_TRACKPAD, SPFC_WIRELESS, SPFC_CPU_MODE, SPFC_ALT_KBD_BL,
+    SPFC_ILLUMIN_FLASH, SPFC_HOTKEYS,
+};
+#define TOS1900_STAT_PIDC       ARRAY_SIZE(tos1900_stat_regs)
+#define TOS1900_STAT_OTHER      (TOS1900_STAT_PIDC + 1)
+#define TOS1900_STAT_SLOTS      (TOS1900_STAT_OTHER + 1)
+#define TOS1900_LAT_BUCKETS     32      /* log2 of the call time in ns */
+
+#define TOS1900_SAVED_REGS      7       /* see tos1900_saved_regs[] */
+
 static int tos1900_add(struct acpi_device *device);
 static int tos1900_remove(struct acpi_device *device);
 static void tos1900_notify(struct acpi_device *device, u32 event);
@@ -112,6 +142,17 @@ struct tos1900_device {
     struct acpi_device  *acpi_dev;
     struct input_dev    *hotkey_dev;
 
+    struct mutex spfc_lock;         /* protects spfc_inflight */
+    struct mutex spfc_set_lock;     /* serialises SPFC set calls */
+    struct list_head spfc_inflight;
+
+    struct tos1900_call_stats __percpu *stats;  /* TOS1900_STAT_SLOTS each */
+    struct dentry *debugfs_dir;
+
+    u32 saved[TOS1900_SAVED_REGS];  /* register values taken at suspend */
+    unsigned long saved_valid;      /* bit i: saved[i] read, not set since */
+    struct work_struct resume_work;
+
     unsigned int lumin_flash_mode:2;
 
     struct device_attribute *lumin_mode_attr;
@@ -123,9 +164,19 @@ struct tos1900_device {
     struct device_attribute *sleep_music_attr;
     struct device_attribute *trackpad_attr;
     struct device_attribute *cpu_mode_attr;
+
+    struct platform_profile_handler profile;
+    bool profile_registered;
+    u32 cpu_mode;                   /* last mode seen, TOS1900_CPU_MODE_* */
 };
 static struct tos1900_device *tos1900_dev;
 
+struct tos1900_call_stats {
+    u64 calls;
+    u64 errors;
+    u64 latency[TOS1900_LAT_BUCKETS];
+};
+
 /*********** Platform Device ***********/
 
 static struct platform_driver tos1900_pf_driver = {
@@ -205,20 +256,126 @@ static const struct key_entry tos1900_keymap[] = {
     { KE_END, 0 },
 };
 
+/*********** Call Statistics ***********/
+
+static int tos1900_stat_slot(u32 reg)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(tos1900_stat_regs); i++)
+        if (tos1900_stat_regs[i] == reg)
+            return i;
+    return TOS1900_STAT_OTHER;
+}
+
+static void tos1900_account(int slot, bool error, u64 ns)
+{
+    struct tos1900_call_stats *stats;
+    int bucket = ns ? min_t(int, ilog2(ns), TOS1900_LAT_BUCKETS - 1) : 0;
+
+    if (!tos1900_dev->stats)
+        return;
+
+    stats = get_cpu_ptr(tos1900_dev->stats) + slot;
+    stats->calls++;
+    if (error)
+        stats->errors++;
+    stats->latency[bucket]++;
+    put_cpu_ptr(tos1900_dev->stats);
+}
+
+static int tos1900_stats_show(struct seq_file *m, void *v)
+{
+    struct tos1900_call_stats sum;
+    int slot, cpu, i;
+
+    seq_puts(m, "reg    calls      errors     latency (log2 ns: count)\n");
+    for (slot = 0; slot < TOS1900_STAT_SLOTS; slot++) {
+        memset(&sum, 0, sizeof(sum));
+        for_each_possible_cpu(cpu) {
+            struct tos1900_call_stats *s =
+                    per_cpu_ptr(tos1900_dev->stats, cpu) + slot;
+
+            sum.calls += s->calls;
+            sum.errors += s->errors;
+            for (i = 0; i < TOS1900_LAT_BUCKETS; i++)
+                sum.latency[i] += s->latency[i];
+        }
+        if (!sum.calls)
+            continue;
+
+        if (slot == TOS1900_STAT_PIDC)
+            seq_puts(m, "pidc  ");
+        else if (slot == TOS1900_STAT_OTHER)
+            seq_puts(m, "other ");
+        else
+            seq_printf(m, "0x%04x", tos1900_stat_regs[slot]);
+        seq_printf(m, " %-10llu %-10llu", sum.calls, sum.errors);
+        for (i = 0; i < TOS1900_LAT_BUCKETS; i++)
+            if (sum.latency[i])
+                seq_printf(m, " %d:%llu", i, sum.latency[i]);
+        seq_putc(m, '\n');
+    }
+
+    return 0;
+}
+
+static int tos1900_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, tos1900_stats_show, NULL);
+}
+
+static const struct file_operations tos1900_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = tos1900_stats_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static void tos1900_debugfs_setup(void)
+{
+    tos1900_dev->stats = __alloc_percpu(
+            sizeof(struct tos1900_call_stats) * TOS1900_STAT_SLOTS,
+            __alignof__(struct tos1900_call_stats));
+    if (!tos1900_dev->stats)
+        return;
+
+    tos1900_dev->debugfs_dir = debugfs_create_dir("toshiba-tos1900", NULL);
+    if (IS_ERR_OR_NULL(tos1900_dev->debugfs_dir)) {
+        tos1900_dev->debugfs_dir = NULL;
+        return;
+    }
+    debugfs_create_file("spfc_stats", S_IRUSR, tos1900_dev->debugfs_dir,
+            NULL, &tos1900_stats_fops);
+}
+
+static void tos1900_debugfs_cleanup(void)
+{
+    debugfs_remove_recursive(tos1900_dev->debugfs_dir);
+    tos1900_dev->debugfs_dir = NULL;
+    free_percpu(tos1900_dev->stats);
+    tos1900_dev->stats = NULL;
+}
+
 /*********** Hardware Communication Functions ***********/
 
 /** Communicate with the SPFC Device (Based on toshiba_acpi.h : hci_raw)
  *  
  *  @param in : SPFC method arguments.
- *  @param out : SPFC return results (can be NULL).
+ *  @param out : SPFC return results (can be NULL); out[0] is SPFC_FAILURE
+ *               when the firmware returned no usable package.
  */
-static acpi_status toshiba_spfc_communicate(const u32 *in, u32 *out)
+static acpi_status __toshiba_spfc_communicate(const u32 *in, u32 *out)
 {
     struct acpi_object_list params;
     union acpi_object in_objs[SPFC_PARAMS];
     struct acpi_buffer results;
     union acpi_object out_objs[SPFC_RESULTS];
     acpi_status status;
+    ktime_t start;
+    u32 result = SPFC_FAILURE;
+    u64 ns;
     int i;
 
     params.count = SPFC_PARAMS;
@@ -231,14 +388,130 @@ static acpi_status toshiba_spfc_communicate(const u32 *in, u32 *out)
     results.length = sizeof(out_objs);
     results.pointer = out_objs;
 
+    start = ktime_get();
     status = acpi_evaluate_object(tos1900_dev->acpi_dev->handle,
             SPFC_PATH, &params, &results);
-    if (out && (status == AE_OK) && (out_objs->package.count < SPFC_RESULTS)) {
-        for (i = 0; i < out_objs->package.count; ++i) {
+    ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    if ((status == AE_OK) && (out_objs->package.count < SPFC_RESULTS)) {
+        for (i = 0; out && i < out_objs->package.count; ++i) {
             out[i] = out_objs->package.elements[i].integer.value;
         }
+        if (out_objs->package.count)
+            result = out_objs->package.elements[0].integer.value;
+    }
+    if (out)
+        out[0] = result;
+
+    /* As in toshiba_acpi: any call that does not return success is an
+     * error, including a rejected result package. */
+    trace_tos1900_spfc_call(in[0], in[1], status, result, ns);
+    tos1900_account(tos1900_stat_slot(in[1]), ACPI_FAILURE(status) ||
+            (result & 0xff00) != SPFC_SUCCESS, ns);
+
+    return status;
+}
+
+/** A pending SPFC get, shared by all callers asking the same question. */
+struct spfc_flight {
+    struct list_head list;
+    u32 in[SPFC_PARAMS];
+    u32 out[SPFC_PARAMS];
+    acpi_status status;
+    struct completion done;
+    int users;                      /* protected by spfc_lock */
+};
+
+static bool toshiba_spfc_is_get(const u32 *in)
+{
+    return in[0] == SPFC_LOWER_GET || in[0] == SPFC_UPPER_GET;
+}
+
+/** Issue a set with spfc_set_lock held, first unhooking pending gets of
+ *  the same register so that later readers do not pick up a value from
+ *  before the write.
+ */
+static acpi_status toshiba_spfc_set_locked(const u32 *in, u32 *out)
+{
+    struct spfc_flight *f, *tmp;
+
+    mutex_lock(&tos1900_dev->spfc_lock);
+    list_for_each_entry_safe(f, tmp, &tos1900_dev->spfc_inflight, list) {
+        if (f->in[1] == in[1])
+            list_del_init(&f->list);
+    }
+    mutex_unlock(&tos1900_dev->spfc_lock);
+
+    return __toshiba_spfc_communicate(in, out);
+}
+
+static void tos1900_snapshot_forget(const u32 *in);
+
+/** Serialise a set.  A register written here is no longer restored by a
+ *  pending resume, so the new value is not reverted to the snapshot.
+ */
+static acpi_status toshiba_spfc_set(const u32 *in, u32 *out)
+{
+    acpi_status status;
+
+    mutex_lock(&tos1900_dev->spfc_set_lock);
+    tos1900_snapshot_forget(in);
+    status = toshiba_spfc_set_locked(in, out);
+    mutex_unlock(&tos1900_dev->spfc_set_lock);
+
+    return status;
+}
+
+/** SPFC transport: identical concurrent gets share one evaluation.
+ *  
+ *  @param in : SPFC method arguments.
+ *  @param out : SPFC return results (can be NULL).
+ */
+static acpi_status toshiba_spfc_communicate(const u32 *in, u32 *out)
+{
+    struct spfc_flight *f;
+    acpi_status status;
+
+    if (!toshiba_spfc_is_get(in))
+        return toshiba_spfc_set(in, out);
+
+    mutex_lock(&tos1900_dev->spfc_lock);
+    list_for_each_entry(f, &tos1900_dev->spfc_inflight, list) {
+        if (!memcmp(f->in, in, sizeof(f->in))) {
+            f->users++;
+            mutex_unlock(&tos1900_dev->spfc_lock);
+            wait_for_completion(&f->done);
+            goto out;
+        }
     }
 
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f) {
+        mutex_unlock(&tos1900_dev->spfc_lock);
+        return __toshiba_spfc_communicate(in, out);
+    }
+    memcpy(f->in, in, sizeof(f->in));
+    init_completion(&f->done);
+    f->users = 1;
+    list_add_tail(&f->list, &tos1900_dev->spfc_inflight);
+    mutex_unlock(&tos1900_dev->spfc_lock);
+
+    f->status = __toshiba_spfc_communicate(f->in, f->out);
+
+    mutex_lock(&tos1900_dev->spfc_lock);
+    list_del_init(&f->list);
+    mutex_unlock(&tos1900_dev->spfc_lock);
+    complete_all(&f->done);
+
+out:
+    if (out)
+        memcpy(out, f->out, sizeof(f->out));
+    status = f->status;
+
+    mutex_lock(&tos1900_dev->spfc_lock);
+    if (--f->users == 0)
+        kfree(f);
+    mutex_unlock(&tos1900_dev->spfc_lock);
+
     return status;
 }
 
@@ -254,6 +527,8 @@ static int toshiba_acpi_is_device(u32 id)
     struct acpi_buffer results;
     union acpi_object out_obj;
     acpi_status status;
+    ktime_t start;
+    u64 ns;
 
     params.count = 1;
     params.pointer = &in_obj;
@@ -262,8 +537,15 @@ static int toshiba_acpi_is_device(u32 id)
     results.length = sizeof(out_obj);
     results.pointer = &out_obj;
 
+    start = ktime_get();
     status = acpi_evaluate_object(tos1900_dev->acpi_dev->handle, PIDC_PATH,
                                   &params, &results);
+    ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    trace_tos1900_pidc_call(id, status, ACPI_SUCCESS(status) ?
+            (u32) out_obj.integer.value : 0, ns);
+    tos1900_account(TOS1900_STAT_PIDC, ACPI_FAILURE(status), ns);
+
     if (ACPI_FAILURE(status))
         return 0;
 
@@ -1070,25 +1352,63 @@ static void toshiba_trackpad_cleanup(void)
 
 /*********** CPU Mode ***********/
 
-static ssize_t toshiba_cpu_mode_show(struct device *dev,
-        struct device_attribute *attr, char* buffer)
+/* The firmware has two CPU modes, matching the SCI cooling method values
+ * used by toshset: 0 is performance, 1 is quiet.
+ */
+#define TOS1900_CPU_MODE_PERFORMANCE    0
+#define TOS1900_CPU_MODE_QUIET          1
+
+static int __toshiba_cpu_mode_get(u32 *mode)
 {
     u32 in[SPFC_PARAMS] = {SPFC_LOWER_GET, SPFC_CPU_MODE, 0, 0, 0, 0};
     u32 out[SPFC_PARAMS];
-    ssize_t count = 0;
 
     if (ACPI_FAILURE(toshiba_spfc_communicate(in, out)))
         return -EIO;
 
-    count = snprintf(buffer, PAGE_SIZE, "%d\n", out[2] & 0x1);
+    *mode = out[2] & 0x1;
+
+    return 0;
+}
+
+/** Set the cpu mode and tell platform_profile listeners if it changed. */
+static int __toshiba_cpu_mode_set(u32 mode)
+{
+    u32 in[SPFC_PARAMS] = {SPFC_LOWER_SET, SPFC_CPU_MODE, 0, 0, 0, 0};
+
+    in[2] = mode ? 1 : 0;
+    if (ACPI_FAILURE(toshiba_spfc_communicate(in, NULL)))
+        return -EIO;
+
+    if (tos1900_dev->cpu_mode != in[2]) {
+        tos1900_dev->cpu_mode = in[2];
+        if (tos1900_dev->profile_registered)
+            platform_profile_notify();
+    }
+
+    return 0;
+}
+
+static ssize_t toshiba_cpu_mode_show(struct device *dev,
+        struct device_attribute *attr, char* buffer)
+{
+    u32 mode;
+    int result;
+    ssize_t count = 0;
+
+    result = __toshiba_cpu_mode_get(&mode);
+    if (result)
+        return result;
+
+    count = snprintf(buffer, PAGE_SIZE, "%d\n", mode);
     return count;
 }
 
 static ssize_t toshiba_cpu_mode_store(struct device *dev,
         struct device_attribute *attr, const char* buffer, size_t count)
 {
-    u32 in[SPFC_PARAMS] = {SPFC_LOWER_SET, SPFC_CPU_MODE, 0, 0, 0, 0};
     unsigned long value;
+    int result;
 
     if (count > 31)
         return -EINVAL;
@@ -1096,13 +1416,90 @@ static ssize_t toshiba_cpu_mode_store(struct device *dev,
     if (kstrtoul(buffer, 10, &value))
         return -EINVAL;
 
-    in[2] = value ? 1 : 0;
-    if (ACPI_FAILURE(toshiba_spfc_communicate(in, NULL)))
-        return -EIO;
+    result = __toshiba_cpu_mode_set(value);
+    if (result)
+        return result;
 
     return count;
 }
 
+static int toshiba_profile_get(struct platform_profile_handler *pprof,
+        enum platform_profile_option *profile)
+{
+    switch (tos1900_dev->cpu_mode) {
+        case TOS1900_CPU_MODE_PERFORMANCE:
+            *profile = PLATFORM_PROFILE_PERFORMANCE;
+            return 0;
+        case TOS1900_CPU_MODE_QUIET:
+            *profile = PLATFORM_PROFILE_QUIET;
+            return 0;
+    }
+
+    return -EIO;
+}
+
+static int toshiba_profile_set(struct platform_profile_handler *pprof,
+        enum platform_profile_option profile)
+{
+    switch (profile) {
+        case PLATFORM_PROFILE_PERFORMANCE:
+            return __toshiba_cpu_mode_set(TOS1900_CPU_MODE_PERFORMANCE);
+        case PLATFORM_PROFILE_QUIET:
+            return __toshiba_cpu_mode_set(TOS1900_CPU_MODE_QUIET);
+        default:
+            return -EOPNOTSUPP;
+    }
+}
+
+/** Pick up a cpu mode change made behind our back, e.g. by a hotkey. */
+static void toshiba_cpu_mode_refresh(void)
+{
+    u32 mode;
+
+    if (!tos1900_dev->profile_registered)
+        return;
+
+    if (__toshiba_cpu_mode_get(&mode))
+        return;
+
+    if (tos1900_dev->cpu_mode != mode) {
+        tos1900_dev->cpu_mode = mode;
+        platform_profile_notify();
+    }
+}
+
+static int toshiba_profile_setup(void)
+{
+    u32 mode;
+    int result;
+
+    result = __toshiba_cpu_mode_get(&mode);
+    if (result)
+        return result;
+    tos1900_dev->cpu_mode = mode;
+
+    tos1900_dev->profile.profile_get = toshiba_profile_get;
+    tos1900_dev->profile.profile_set = toshiba_profile_set;
+    set_bit(PLATFORM_PROFILE_PERFORMANCE, tos1900_dev->profile.choices);
+    set_bit(PLATFORM_PROFILE_QUIET, tos1900_dev->profile.choices);
+
+    result = platform_profile_register(&tos1900_dev->profile);
+    if (result)
+        return result;
+
+    tos1900_dev->profile_registered = true;
+
+    return 0;
+}
+
+static void toshiba_profile_cleanup(void)
+{
+    if (tos1900_dev->profile_registered) {
+        platform_profile_remove();
+        tos1900_dev->profile_registered = false;
+    }
+}
+
 static int toshiba_cpu_mode_setup(void)
 {
     int result;
@@ -1123,6 +1520,10 @@ static int toshiba_cpu_mode_setup(void)
     if (result)
         goto outkzalloc;
 
+    /* Not fatal: the sysfs file still works without a profile handler. */
+    if (toshiba_profile_setup())
+        pr_warn("Could not register platform profile\n");
+
     return 0;
 
 outkzalloc:
@@ -1133,6 +1534,8 @@ outkzalloc:
 
 static void toshiba_cpu_mode_cleanup(void)
 {
+    toshiba_profile_cleanup();
+
     if (tos1900_dev->cpu_mode_attr) {
         device_remove_file(&tos1900_pf_device->dev,
                 tos1900_dev->cpu_mode_attr);
@@ -1141,6 +1544,130 @@ static void toshiba_cpu_mode_cleanup(void)
     }
 }
 
+/*********** Suspend/Resume Snapshot ***********/
+
+/* Settings the firmware may lose or reset over a sleep cycle.  Each entry
+ * is only saved when the feature was set up (its attribute exists), and
+ * only the bits covered by mask are compared and written back.
+ */
+static const struct tos1900_saved_reg {
+    u32 get;
+    u32 set;
+    u32 reg;
+    u32 mask;
+    size_t attr;        /* offset of the attribute pointer in tos1900_dev */
+} tos1900_saved_regs[TOS1900_SAVED_REGS] = {
+    { SPFC_UPPER_GET, SPFC_UPPER_SET, SPFC_ILLUMINATION, 0x1,
+      offsetof(struct tos1900_device, lumin_mode_attr) },
+    { SPFC_UPPER_GET, SPFC_UPPER_SET, SPFC_KBD_BACKLIGHT, 0x00FFFFFF,
+      offsetof(struct tos1900_device, kbdbl_mode_attr) },
+    { SPFC_LOWER_GET, SPFC_LOWER_SET, SPFC_ALT_KBD_BL, 0x1,
+      offsetof(struct tos1900_device, alt_kbdbl_attr) },
+    { SPFC_UPPER_GET, SPFC_UPPER_SET, SPFC_BOOT_SPEED, 0x1,
+      offsetof(struct tos1900_device, boot_speed_attr) },
+    { SPFC_UPPER_GET, SPFC_UPPER_SET, SPFC_SLEEP_MUSIC, 0x1,
+      offsetof(struct tos1900_device, sleep_music_attr) },
+    { SPFC_UPPER_GET, SPFC_UPPER_SET, SPFC_TRACKPAD, 0x1,
+      offsetof(struct tos1900_device, trackpad_attr) },
+    { SPFC_LOWER_GET, SPFC_LOWER_SET, SPFC_CPU_MODE, 0x1,
+      offsetof(struct tos1900_device, cpu_mode_attr) },
+};
+
+static bool tos1900_saved_reg_present(const struct tos1900_saved_reg *r)
+{
+    return *(struct device_attribute **)((char *)tos1900_dev + r->attr);
+}
+
+static int tos1900_saved_reg_read(const struct tos1900_saved_reg *r,
+        u32 *value)
+{
+    u32 in[SPFC_PARAMS] = {r->get, r->reg, 0, 0, 0, 0};
+    u32 out[SPFC_PARAMS];
+
+    if (ACPI_FAILURE(toshiba_spfc_communicate(in, out)) ||
+            (out[0] & 0xff00) != SPFC_SUCCESS)
+        return -EIO;
+
+    *value = out[2] & r->mask;
+
+    return 0;
+}
+
+/** Read every present register once and keep the values for resume. */
+static void tos1900_snapshot_save(void)
+{
+    int i;
+
+    tos1900_dev->saved_valid = 0;
+
+    for (i = 0; i < TOS1900_SAVED_REGS; ++i) {
+        const struct tos1900_saved_reg *r = &tos1900_saved_regs[i];
+
+        if (!tos1900_saved_reg_present(r))
+            continue;
+
+        if (!tos1900_saved_reg_read(r, &tos1900_dev->saved[i]))
+            set_bit(i, &tos1900_dev->saved_valid);
+    }
+}
+
+/** Drop a register from the snapshot once it has been set, so that a
+ *  restore still queued from resume leaves the new value alone.  Called
+ *  with spfc_set_lock held.
+ */
+static void tos1900_snapshot_forget(const u32 *in)
+{
+    int i;
+
+    for (i = 0; i < TOS1900_SAVED_REGS; ++i) {
+        if (tos1900_saved_regs[i].set == in[0] &&
+                tos1900_saved_regs[i].reg == in[1])
+            clear_bit(i, &tos1900_dev->saved_valid);
+    }
+}
+
+/** Write back the saved registers that the firmware no longer agrees with.
+ *
+ *  Each write is checked against saved_valid under spfc_set_lock, so a
+ *  register set since resume keeps the newer value.  The illumination
+ *  flash mode can not be read back, so the cached value is always
+ *  rewritten.
+ */
+static void tos1900_snapshot_restore(void)
+{
+    u32 in[SPFC_PARAMS] = {0, 0, 0, 0, 0, 0};
+    u32 value;
+    int i;
+
+    for_each_set_bit(i, &tos1900_dev->saved_valid, TOS1900_SAVED_REGS) {
+        const struct tos1900_saved_reg *r = &tos1900_saved_regs[i];
+
+        if (!tos1900_saved_reg_read(r, &value) &&
+                value == tos1900_dev->saved[i])
+            continue;
+
+        in[0] = r->set;
+        in[1] = r->reg;
+        in[2] = tos1900_dev->saved[i];
+        mutex_lock(&tos1900_dev->spfc_set_lock);
+        if (test_bit(i, &tos1900_dev->saved_valid) &&
+                ACPI_FAILURE(toshiba_spfc_set_locked(in, NULL)))
+            pr_warn("Could not restore register 0x%04x\n", r->reg);
+        mutex_unlock(&tos1900_dev->spfc_set_lock);
+    }
+
+    if (tos1900_dev->lumin_flash_attr)
+        __toshiba_illumination_flash_store(tos1900_dev->lumin_flash_mode);
+}
+
+/** Deferred part of resume; keeps ACPI calls off the resume path. */
+static void tos1900_resume_work(struct work_struct *work)
+{
+    tos1900_enable_hotkeys();
+    tos1900_snapshot_restore();
+    toshiba_cpu_mode_refresh();
+}
+
 /*********** TODO: Wireless ***********/
 
 static int toshiba_acpi_wireless_setup(void)
@@ -1251,6 +1778,12 @@ static int tos1900_add(struct acpi_device *device)
 
     device->driver_data = tos1900_dev;
     tos1900_dev->acpi_dev = device;
+    mutex_init(&tos1900_dev->spfc_lock);
+    mutex_init(&tos1900_dev->spfc_set_lock);
+    INIT_LIST_HEAD(&tos1900_dev->spfc_inflight);
+    INIT_WORK(&tos1900_dev->resume_work, tos1900_resume_work);
+
+    tos1900_debugfs_setup();
 
     result = tos1900_pf_add();
     if (result)
@@ -1280,17 +1813,21 @@ outacpi:
 outpf:
     tos1900_pf_remove();
 out:
+    tos1900_debugfs_cleanup();
     kfree(tos1900_dev);
     return result;
 }
 
 static int tos1900_remove(struct acpi_device *device)
 {
+    cancel_work_sync(&tos1900_dev->resume_work);
+
     toshiba_acpi_wireless_cleanup();
     toshiba_acpi_keyboard_cleanup();
     tos1900_acpi_cleanup();
 
     tos1900_pf_remove();
+    tos1900_debugfs_cleanup();
 
     kfree(tos1900_dev);
     tos1900_dev = NULL;
@@ -1307,6 +1844,8 @@ static void tos1900_notify(struct acpi_device *device, u32 event)
     if (event != 0x80)
         return;
 
+    toshiba_cpu_mode_refresh();
+
     status = acpi_evaluate_integer(device->handle, "INFO", NULL, &hotkey);
     if (ACPI_FAILURE(status))
         return;
@@ -1326,13 +1865,17 @@ static void tos1900_notify(struct acpi_device *device, u32 event)
 #ifdef CONFIG_PM_SLEEP
 static int tos1900_suspend(struct device *device)
 {
+    /* A restore from the previous resume may still be running. */
+    flush_work(&tos1900_dev->resume_work);
+
+    tos1900_snapshot_save();
     tos1900_disable_hotkeys();
     return 0;
 }
 
 static int tos1900_resume(struct device *device)
 {
-    tos1900_enable_hotkeys();
+    schedule_work(&tos1900_dev->resume_work);
     return 0;
 }
 #endif
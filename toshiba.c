@@ -51,11 +51,22 @@
 #include <linux/slab.h>
 #include <linux/workqueue.h>
 #include <linux/i8042.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/thermal.h>
 
 #include <asm/uaccess.h>
 
 #include <acpi/acpi_drivers.h>
 
+#define CREATE_TRACE_POINTS
+#include "toshiba_trace.h"
+
 MODULE_AUTHOR("John Belmonte");
 MODULE_DESCRIPTION("Toshiba Laptop ACPI Extras Driver");
 MODULE_LICENSE("GPL");
@@ -102,6 +113,16 @@ MODULE_LICENSE("GPL");
 #define HCI_WIRELESS			0x0056
 #define HCI_TOUCHPAD			0x050e
 
+/* registers with their own slot in the debugfs call statistics; anything
+ * else is accounted to the final "other" slot
+ */
+static const u32 hci_stat_regs[] = {
+	HCI_FAN, HCI_TR_BACKLIGHT, HCI_SYSTEM_EVENT, HCI_VIDEO_OUT,
+	HCI_HOTKEY_EVENT, HCI_LCD_BRIGHTNESS, HCI_WIRELESS, HCI_TOUCHPAD,
+};
+#define HCI_STAT_SLOTS			(ARRAY_SIZE(hci_stat_regs) + 1)
+#define HCI_LAT_BUCKETS			32	/* log2 of the call time in ns */
+
 /* field definitions */
 
 #define HCI_HOTKEY_S1 0x02 /* 0b0010,  HKEV &&  HKHS, unknown */
@@ -122,14 +143,48 @@ MODULE_LICENSE("GPL");
 #define HCI_WIRELESS_BT_PRESENT		0x0f
 #define HCI_WIRELESS_BT_ATTACH		0x40
 #define HCI_WIRELESS_BT_POWER		0x80
+#define HCI_FAN_OFF			0x00
+#define HCI_FAN_LOW4			0x18	/* 1/8 */
+#define HCI_FAN_LOW2			0x30	/* 1/4 */
+#define HCI_FAN_LOW3			0x90	/* 2/4 */
+#define HCI_FAN_HIGH2			0x60	/* 3/4 */
+#define HCI_FAN_HIGH			0xff
 
 
 static DEVICE_ATTR_RW(touchpad);
 static DEVICE_ATTR_RW(cpu_mode);
 
-struct toshiba_dev {
+struct toshiba_acpi_dev {
 	struct acpi_device *acpi_dev;
 	const char *method_hci;
+
+	struct mutex hci_lock;		/* protects hci_inflight */
+	struct mutex hci_set_lock;	/* serialises HCI SET calls */
+	struct list_head hci_inflight;
+
+	struct hci_call_stats __percpu *hci_stats; /* HCI_STAT_SLOTS each */
+	struct dentry *debugfs_dir;
+
+	struct thermal_cooling_device *fan_cdev;
+	int fan_state;			/* cached cooling state, -1 if stale */
+};
+
+struct hci_call_stats {
+	u64 calls;
+	u64 errors;
+	u64 latency[HCI_LAT_BUCKETS];
+};
+
+/* An HCI GET being evaluated, shared by every caller asking the same
+ * question while it is pending.
+ */
+struct hci_flight {
+	struct list_head list;
+	u32 in[HCI_WORDS];
+	u32 out[HCI_WORDS];
+	acpi_status status;
+	struct completion done;
+	int users;		/* protected by hci_lock */
 };
 
 static const struct acpi_device_id toshiba_device_ids[] = {
@@ -166,17 +221,123 @@ static int write_acpi_int(const char *methodName, int val)
 	return (status == AE_OK) ? 0 : -EIO;
 }
 
+/* call statistics
+ */
+
+static int hci_stat_slot(u32 reg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(hci_stat_regs); i++)
+		if (hci_stat_regs[i] == reg)
+			return i;
+	return ARRAY_SIZE(hci_stat_regs);
+}
+
+static void hci_account(struct toshiba_acpi_dev *dev, const u32 in[HCI_WORDS],
+			acpi_status status, u32 result, u64 ns)
+{
+	struct hci_call_stats *stats;
+	int bucket = ns ? min_t(int, ilog2(ns), HCI_LAT_BUCKETS - 1) : 0;
+
+	trace_toshiba_hci_call(dev->method_hci, in[0], in[1], status, result,
+			       ns);
+
+	if (!dev->hci_stats)
+		return;
+
+	stats = get_cpu_ptr(dev->hci_stats) + hci_stat_slot(in[1]);
+	stats->calls++;
+	if (status != AE_OK || (result & 0xff00) != HCI_SUCCESS)
+		stats->errors++;
+	stats->latency[bucket]++;
+	put_cpu_ptr(dev->hci_stats);
+}
+
+static int hci_stats_show(struct seq_file *m, void *v)
+{
+	struct toshiba_acpi_dev *dev = m->private;
+	struct hci_call_stats sum;
+	int slot, cpu, i;
+
+	seq_puts(m, "reg    calls      errors     latency (log2 ns: count)\n");
+	for (slot = 0; slot < HCI_STAT_SLOTS; slot++) {
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct hci_call_stats *s =
+				per_cpu_ptr(dev->hci_stats, cpu) + slot;
+
+			sum.calls += s->calls;
+			sum.errors += s->errors;
+			for (i = 0; i < HCI_LAT_BUCKETS; i++)
+				sum.latency[i] += s->latency[i];
+		}
+		if (!sum.calls)
+			continue;
+
+		if (slot < ARRAY_SIZE(hci_stat_regs))
+			seq_printf(m, "0x%04x", hci_stat_regs[slot]);
+		else
+			seq_puts(m, "other ");
+		seq_printf(m, " %-10llu %-10llu", sum.calls, sum.errors);
+		for (i = 0; i < HCI_LAT_BUCKETS; i++)
+			if (sum.latency[i])
+				seq_printf(m, " %d:%llu", i, sum.latency[i]);
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int hci_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hci_stats_show, inode->i_private);
+}
+
+static const struct file_operations hci_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= hci_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void toshiba_acpi_debugfs_init(struct toshiba_acpi_dev *dev)
+{
+	dev->hci_stats = __alloc_percpu(sizeof(struct hci_call_stats) *
+					HCI_STAT_SLOTS,
+					__alignof__(struct hci_call_stats));
+	if (!dev->hci_stats)
+		return;
+
+	dev->debugfs_dir = debugfs_create_dir("toshiba_acpi", NULL);
+	if (IS_ERR_OR_NULL(dev->debugfs_dir)) {
+		dev->debugfs_dir = NULL;
+		return;
+	}
+	debugfs_create_file("hci_stats", S_IRUSR, dev->debugfs_dir, dev,
+			    &hci_stats_fops);
+}
+
+static void toshiba_acpi_debugfs_remove(struct toshiba_acpi_dev *dev)
+{
+	debugfs_remove_recursive(dev->debugfs_dir);
+	free_percpu(dev->hci_stats);
+}
+
 /* Perform a raw HCI call.  Here we don't care about input or output buffer
  * format.
  */
-static acpi_status hci_raw(struct toshiba_acpi_dev *dev,
-			   const u32 in[HCI_WORDS], u32 out[HCI_WORDS])
+static acpi_status __hci_raw(struct toshiba_acpi_dev *dev,
+			     const u32 in[HCI_WORDS], u32 out[HCI_WORDS])
 {
 	struct acpi_object_list params;
 	union acpi_object in_objs[HCI_WORDS];
 	struct acpi_buffer results;
 	union acpi_object out_objs[HCI_WORDS + 1];
 	acpi_status status;
+	ktime_t start;
+	u32 result = HCI_FAILURE;
 	int i;
 
 	params.count = HCI_WORDS;
@@ -189,6 +350,7 @@ static acpi_status hci_raw(struct toshiba_acpi_dev *dev,
 	results.length = sizeof(out_objs);
 	results.pointer = out_objs;
 
+	start = ktime_get();
 	status = acpi_evaluate_object(dev->acpi_dev->handle,
 				      (char *)dev->method_hci, &params,
 				      &results);
@@ -196,7 +358,94 @@ static acpi_status hci_raw(struct toshiba_acpi_dev *dev,
 		for (i = 0; i < out_objs->package.count; ++i) {
 			out[i] = out_objs->package.elements[i].integer.value;
 		}
+		if (out_objs->package.count)
+			result = out[0];
 	}
+	/* a package too large for out is accounted as a failed call */
+	hci_account(dev, in, status, result,
+		    ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	return status;
+}
+
+static bool hci_is_get(const u32 in[HCI_WORDS])
+{
+	return in[0] == HCI_GET || in[0] == HCI_TPAD_GET;
+}
+
+/* SETs are serialised.  Any GET of the same register still pending is
+ * unhooked first, so readers arriving after the SET evaluate afresh
+ * instead of attaching to a result from before it.
+ */
+static acpi_status hci_raw_set(struct toshiba_acpi_dev *dev,
+			       const u32 in[HCI_WORDS], u32 out[HCI_WORDS])
+{
+	struct hci_flight *f, *tmp;
+	acpi_status status;
+
+	mutex_lock(&dev->hci_set_lock);
+
+	mutex_lock(&dev->hci_lock);
+	list_for_each_entry_safe(f, tmp, &dev->hci_inflight, list)
+		if (f->in[1] == in[1])
+			list_del_init(&f->list);
+	mutex_unlock(&dev->hci_lock);
+
+	status = __hci_raw(dev, in, out);
+
+	mutex_unlock(&dev->hci_set_lock);
+	return status;
+}
+
+/* GETs are merged: a caller whose input words match a pending GET waits
+ * for that evaluation and shares its result, rather than paying for its
+ * own (sysfs, ioctl and rfkill polling tend to ask at the same moment).
+ */
+static acpi_status hci_raw(struct toshiba_acpi_dev *dev,
+			   const u32 in[HCI_WORDS], u32 out[HCI_WORDS])
+{
+	struct hci_flight *f;
+	acpi_status status;
+
+	if (!hci_is_get(in))
+		return hci_raw_set(dev, in, out);
+
+	mutex_lock(&dev->hci_lock);
+	list_for_each_entry(f, &dev->hci_inflight, list) {
+		if (!memcmp(f->in, in, sizeof(f->in))) {
+			f->users++;
+			mutex_unlock(&dev->hci_lock);
+			wait_for_completion(&f->done);
+			goto out;
+		}
+	}
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f) {
+		mutex_unlock(&dev->hci_lock);
+		return __hci_raw(dev, in, out);
+	}
+	memcpy(f->in, in, sizeof(f->in));
+	init_completion(&f->done);
+	f->users = 1;
+	list_add_tail(&f->list, &dev->hci_inflight);
+	mutex_unlock(&dev->hci_lock);
+
+	f->status = __hci_raw(dev, f->in, f->out);
+
+	mutex_lock(&dev->hci_lock);
+	list_del_init(&f->list);
+	mutex_unlock(&dev->hci_lock);
+	complete_all(&f->done);
+
+out:
+	memcpy(out, f->out, sizeof(f->out));
+	status = f->status;
+
+	mutex_lock(&dev->hci_lock);
+	if (--f->users == 0)
+		kfree(f);
+	mutex_unlock(&dev->hci_lock);
 
 	return status;
 }
@@ -250,11 +499,114 @@ static acpi_status hci_read2(struct toshiba_acpi_dev *dev, u32 reg,
 	return status;
 }
 
+/*** Fan cooling device ***/
+
+/* Cooling states in increasing order of airflow.  Values the firmware
+ * reports that are not in this table (fan1/fan2/low/high1 on some models)
+ * are reported as the lowest running state.
+ */
+static const u32 fan_levels[] = {
+	HCI_FAN_OFF, HCI_FAN_LOW4, HCI_FAN_LOW2, HCI_FAN_LOW3, HCI_FAN_HIGH2,
+	HCI_FAN_HIGH,
+};
+
+static int fan_level_to_state(u32 level)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fan_levels); ++i)
+		if (fan_levels[i] == level)
+			return i;
+
+	return level ? 1 : 0;
+}
+
+static int fan_get_max_state(struct thermal_cooling_device *cdev,
+			     unsigned long *state)
+{
+	*state = ARRAY_SIZE(fan_levels) - 1;
+	return 0;
+}
+
+static int fan_get_cur_state(struct thermal_cooling_device *cdev,
+			     unsigned long *state)
+{
+	struct toshiba_acpi_dev *dev = cdev->devdata;
+	int cached = READ_ONCE(dev->fan_state);
+	u32 level, hci_result;
+
+	if (cached < 0) {
+		hci_read1(dev, HCI_FAN, &level, &hci_result);
+		if (hci_result != HCI_SUCCESS)
+			return -EIO;
+		cached = fan_level_to_state(level & 0xff);
+		WRITE_ONCE(dev->fan_state, cached);
+	}
+
+	*state = cached;
+	return 0;
+}
+
+static int fan_set_cur_state(struct thermal_cooling_device *cdev,
+			     unsigned long state)
+{
+	struct toshiba_acpi_dev *dev = cdev->devdata;
+	u32 hci_result;
+
+	if (state >= ARRAY_SIZE(fan_levels))
+		return -EINVAL;
+
+	if (READ_ONCE(dev->fan_state) == state)
+		return 0;
+
+	hci_write1(dev, HCI_FAN, fan_levels[state], &hci_result);
+	if (hci_result != HCI_SUCCESS) {
+		WRITE_ONCE(dev->fan_state, -1);
+		return -EIO;
+	}
+
+	WRITE_ONCE(dev->fan_state, state);
+	return 0;
+}
+
+static const struct thermal_cooling_device_ops fan_cooling_ops = {
+	.get_max_state	= fan_get_max_state,
+	.get_cur_state	= fan_get_cur_state,
+	.set_cur_state	= fan_set_cur_state,
+};
+
+static void toshiba_acpi_fan_init(struct toshiba_acpi_dev *dev)
+{
+	u32 level, hci_result;
+
+	dev->fan_state = -1;
+
+	hci_read1(dev, HCI_FAN, &level, &hci_result);
+	if (hci_result != HCI_SUCCESS)
+		return;
+
+	dev->fan_cdev = thermal_cooling_device_register("toshiba_fan", dev,
+							&fan_cooling_ops);
+	if (IS_ERR(dev->fan_cdev)) {
+		pr_warn("Failed to register fan cooling device\n");
+		dev->fan_cdev = NULL;
+	}
+}
+
+static void toshiba_acpi_fan_remove(struct toshiba_acpi_dev *dev)
+{
+	if (dev->fan_cdev)
+		thermal_cooling_device_unregister(dev->fan_cdev);
+}
+
 /*** Driver ***/
 
 static int toshiba_acpi_remove(struct acpi_device *acpi_dev)
 {
 	struct toshiba_acpi_dev *dev = acpi_driver_data(acpi_dev);
+
+	toshiba_acpi_fan_remove(dev);
+	toshiba_acpi_debugfs_remove(dev);
 	kfree(dev);
 	return 0;
 }
@@ -300,8 +652,14 @@ static int toshiba_acpi_add(struct acpi_device *acpi_dev)
 
 	dev->acpi_dev = acpi_dev;
 	dev->method_hci = hci_method;
+	mutex_init(&dev->hci_lock);
+	mutex_init(&dev->hci_set_lock);
+	INIT_LIST_HEAD(&dev->hci_inflight);
 	acpi_dev->driver_data = dev;
 
+	toshiba_acpi_debugfs_init(dev);
+	toshiba_acpi_fan_init(dev);
+
 	pr_info("loaded %s\n", acpi_dev->driver->name);
 
 	return ret;
@@ -311,6 +669,14 @@ static void toshiba_acpi_notify(struct acpi_device *acpi_dev, u32 event)
 {
 	struct toshiba_acpi_dev *dev = acpi_driver_data(acpi_dev);
 
+	/* The firmware may have moved the fan itself (thermal event, Fn key);
+	 * drop the cached state so the next get_cur_state reads HCI_FAN.
+	 * Don't call thermal_cdev_update() here: it doesn't read anything, it
+	 * pushes the governor's target, which is 0 with no zone bound.
+	 */
+	if (dev->fan_cdev)
+		WRITE_ONCE(dev->fan_state, -1);
+
 	pr_info("event: 0x%02x\n", event);
 }
 
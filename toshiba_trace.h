@@ -0,0 +1,58 @@
+/*
+ *  toshiba_trace.h - tracepoints for the Toshiba HCI firmware interface
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM toshiba_acpi
+
+#if !defined(_TOSHIBA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TOSHIBA_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* One evaluation of the GHCI/SPFC method.  result is the HCI return code
+ * (out[0]), only meaningful when status is AE_OK.
+ */
+TRACE_EVENT(toshiba_hci_call,
+
+	TP_PROTO(const char *method, u32 op, u32 reg, u32 status, u32 result,
+		 u64 duration_ns),
+
+	TP_ARGS(method, op, reg, status, result, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(method, method)
+		__field(u32, op)
+		__field(u32, reg)
+		__field(u32, status)
+		__field(u32, result)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(method, method);
+		__entry->op = op;
+		__entry->reg = reg;
+		__entry->status = status;
+		__entry->result = result;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s op=0x%04x reg=0x%04x status=0x%x result=0x%04x duration=%llu ns",
+		  __get_str(method), __entry->op, __entry->reg,
+		  __entry->status, __entry->result,
+		  (unsigned long long)__entry->duration_ns)
+);
+
+#endif /* _TOSHIBA_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE toshiba_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,197 @@
+/* batchRead.c -- batched reads through io_uring
+ *
+ * Querying every sysfs setting costs a read() per attribute. Here the
+ * reads are queued on an io_uring and handed to the kernel with a single
+ * io_uring_enter(), which also waits for all of them to complete; a full
+ * query is one system call however many attributes it covers.
+ *
+ * The ring is set up on first use and kept, talking to the kernel with
+ * the raw system calls so that no liburing is needed. Where io_uring is
+ * missing (older kernels, or disabled by sysctl or seccomp) or does not
+ * know IORING_OP_READ, each file is read with pread() instead.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<string.h>
+#include<errno.h>
+#include<limits.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+
+#include "batchRead.h"
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#  include<linux/io_uring.h>
+#  define HAVE_IO_URING
+#endif
+
+#define BATCH_ENTRIES 32
+#define BATCH_PENDING INT_MIN     /* res[] of a read not done yet */
+
+#ifdef HAVE_IO_URING
+
+static struct {
+  int                   fd;       /* -1: not set up, -2: unavailable */
+  unsigned*             sqHead;
+  unsigned*             sqTail;
+  unsigned*             sqMask;
+  unsigned*             sqArray;
+  unsigned*             cqHead;
+  unsigned*             cqTail;
+  unsigned*             cqMask;
+  struct io_uring_sqe*  sqes;
+  struct io_uring_cqe*  cqes;
+  unsigned              entries;
+} ring = { -1 };
+
+static int
+ringSetup()
+{
+ struct io_uring_params p;
+ size_t sqSize,cqSize;
+ char* sq;
+ char* cq;
+ void* sqes;
+ int fd;
+
+ ring.fd = -2;
+ memset(&p,0,sizeof(p));
+ if ( (fd=syscall(__NR_io_uring_setup,BATCH_ENTRIES,&p))<0 )
+   return 1;
+
+ sqSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+ cqSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+ if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+   if ( cqSize>sqSize )
+     sqSize = cqSize;
+   cqSize = sqSize;
+ }
+ sq = mmap(0,sqSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,
+	   IORING_OFF_SQ_RING);
+ if ( sq==MAP_FAILED ) {
+   close(fd);
+   return 1;
+ }
+ cq = sq;
+ if ( !(p.features & IORING_FEAT_SINGLE_MMAP) ) {
+   cq = mmap(0,cqSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,
+	     IORING_OFF_CQ_RING);
+   if ( cq==MAP_FAILED ) {
+     munmap(sq,sqSize);
+     close(fd);
+     return 1;
+   }
+ }
+ sqes = mmap(0,p.sq_entries*sizeof(struct io_uring_sqe),
+	     PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES);
+ if ( sqes==MAP_FAILED ) {
+   if ( cq!=sq )
+     munmap(cq,cqSize);
+   munmap(sq,sqSize);
+   close(fd);
+   return 1;
+ }
+
+ ring.sqHead  = (unsigned*) (sq+p.sq_off.head);
+ ring.sqTail  = (unsigned*) (sq+p.sq_off.tail);
+ ring.sqMask  = (unsigned*) (sq+p.sq_off.ring_mask);
+ ring.sqArray = (unsigned*) (sq+p.sq_off.array);
+ ring.cqHead  = (unsigned*) (cq+p.cq_off.head);
+ ring.cqTail  = (unsigned*) (cq+p.cq_off.tail);
+ ring.cqMask  = (unsigned*) (cq+p.cq_off.ring_mask);
+ ring.cqes    = (struct io_uring_cqe*) (cq+p.cq_off.cqes);
+ ring.sqes    = sqes;
+ ring.entries = p.sq_entries;
+ ring.fd      = fd;
+ return 0;
+} /* ringSetup */
+
+/*
+ * queue reads first..first+m-1 and wait for them all; 1 if the ring
+ * failed, in which case it is not used again
+ */
+static int
+ringRead(int first, int m, const int* fd, char* const* buf, const int* len,
+	 int* res)
+{
+ unsigned tail = *ring.sqTail;
+ unsigned head;
+ int i,got=0;
+
+ for (i=first ; i<first+m ; i++) {
+   unsigned idx = tail & *ring.sqMask;
+   struct io_uring_sqe* sqe = &ring.sqes[idx];
+
+   memset(sqe,0,sizeof(*sqe));
+   sqe->opcode    = IORING_OP_READ;
+   sqe->fd        = fd[i];
+   sqe->addr      = (unsigned long) buf[i];
+   sqe->len       = len[i];
+   sqe->off       = 0;
+   sqe->user_data = i;
+   ring.sqArray[idx] = idx;
+   tail++;
+ }
+ __atomic_store_n(ring.sqTail,tail,__ATOMIC_RELEASE);
+
+ if ( syscall(__NR_io_uring_enter,ring.fd,m,m,
+	      IORING_ENTER_GETEVENTS,0,0)<0 ) {
+   ring.fd = -2;
+   return 1;
+ }
+
+ head = *ring.cqHead;
+ while ( got<m ) {
+   unsigned cqTail = __atomic_load_n(ring.cqTail,__ATOMIC_ACQUIRE);
+
+   if ( head==cqTail ) {
+     // interrupted before everything completed
+     if ( syscall(__NR_io_uring_enter,ring.fd,0,m-got,
+		  IORING_ENTER_GETEVENTS,0,0)<0 && errno!=EINTR ) {
+       ring.fd = -2;
+       return 1;
+     }
+     continue;
+   }
+   for ( ; head!=cqTail ; head++, got++) {
+     struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+     res[cqe->user_data] = cqe->res;
+   }
+   __atomic_store_n(ring.cqHead,head,__ATOMIC_RELEASE);
+ }
+ return 0;
+} /* ringRead */
+
+#endif /* HAVE_IO_URING */
+
+void
+batchRead(int n, const int* fd, char* const* buf, const int* len, int* res)
+{
+ int i;
+
+ for (i=0 ; i<n ; i++)
+   res[i] = BATCH_PENDING;
+
+#ifdef HAVE_IO_URING
+ if ( ring.fd==-1 )
+   ringSetup();
+ for (i=0 ; i<n && ring.fd>=0 ; i+=ring.entries) {
+   int m = n-i<(int)ring.entries ? n-i : (int)ring.entries;
+   if ( ringRead(i,m,fd,buf,len,res) )
+     break;
+ }
+#endif /* HAVE_IO_URING */
+
+ // whatever the ring did not do, or kernels without IORING_OP_READ
+ // refused with EINVAL, is read the ordinary way
+ for (i=0 ; i<n ; i++)
+   if ( res[i]==BATCH_PENDING || res[i]==-EINVAL ) {
+     ssize_t r = pread(fd[i],buf[i],len[i],0);
+     res[i] = r<0 ? -errno : (int) r;
+   }
+} /* batchRead */
@@ -0,0 +1,24 @@
+
+#ifndef __batchRead_h__
+#define __batchRead_h__
+
+/*
+  read several files at offset 0 with as few system calls as possible:
+one io_uring submission where the kernel has it, otherwise a pread() per
+file. See batchRead.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// read up to len[i] bytes of fd[i] into buf[i], for i<n. res[i] is the
+// byte count, or -errno if that read failed.
+void batchRead(int n, const int* fd, char* const* buf, const int* len,
+	       int* res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __batchRead_h__ */
@@ -0,0 +1,44 @@
+#!/bin/sh
+# bench-args.sh -- time toshset on long scripted command lines
+#
+#   sh bench-args.sh [toshset] [flags] [settings]
+#
+# Runs toshset on the emulated Tecra 9100, first with a command line of
+# <flags> toggle flags (100000 by default), then with -txn and <settings>
+# settings (60000 by default), and prints the wall time of each in
+# seconds. These are the command lines that used to be quadratic in the
+# number of arguments; see FlagIndex and applyPending() in toshset.cc.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+TOSHSET=${1:-./toshset}
+FLAGS=${2:-100000}
+SETTINGS=${3:-60000}
+
+TOSHSET_EMULATE=tecra9100
+export TOSHSET_EMULATE
+
+now() {
+ date +%s.%N
+}
+
+# seconds since $1
+since() {
+ echo "$1 `now`" | awk '{ printf "%.2f", $2-$1 }'
+}
+
+# an even number of -fast toggles leaves checks on, as without any
+args=`awk -v n=$FLAGS 'BEGIN { for (i=0 ; i<n ; i++) printf "-fast " }'`
+start=`now`
+$TOSHSET $args -q cpu >/dev/null || exit 1
+echo "$FLAGS toggle flags: `since $start` s"
+
+# every setting overrides the one before, so -txn writes only the last
+args=`awk -v n=$SETTINGS 'BEGIN {
+ for (i=0 ; i<n ; i++) printf "-c %s ", i%2 ? "quiet" : "perform" }'`
+start=`now`
+$TOSHSET -fast -txn $args >/dev/null || exit 1
+echo "$SETTINGS -txn settings: `since $start` s"
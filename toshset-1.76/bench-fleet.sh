@@ -0,0 +1,57 @@
+#!/bin/sh
+# bench-fleet.sh -- time toshset-fleet on a synthetic fleet of snapshots
+#
+#   sh bench-fleet.sh [bindir] [count]
+#
+# Takes a snapshot of each emulated model with toshset, has fleetgen
+# write <count> images from them (100000 by default) under
+# $FLEETDIR (${TMPDIR:-/tmp}/toshset-fleet-bench), unless a fleet of
+# that size is there already, then summarizes it with toshset-fleet on
+# one thread and on one per CPU (at least four), file names fed from
+# find(1). Prints the wall time of each run in seconds, and checks that
+# both runs give the same report.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+BINDIR=${1:-.}
+COUNT=${2:-100000}
+FLEETDIR=${FLEETDIR:-${TMPDIR:-/tmp}/toshset-fleet-bench}
+MODELS="tecra9100 libretto50"
+
+now() {
+ date +%s.%N
+}
+
+# seconds since $1
+since() {
+ echo "$1 `now`" | awk '{ printf "%.2f", $2-$1 }'
+}
+
+if [ "`cat $FLEETDIR/count 2>/dev/null`" != "$COUNT" ]; then
+ rm -rf $FLEETDIR
+ mkdir -p $FLEETDIR/templates || exit 1
+ templates=
+ for m in $MODELS; do
+   TOSHSET_EMULATE=$m $BINDIR/toshset -snapshot $FLEETDIR/templates/$m \
+     >/dev/null || exit 1
+   templates="$templates $FLEETDIR/templates/$m"
+ done
+ start=`now`
+ $BINDIR/fleetgen $FLEETDIR/images $COUNT $templates || exit 1
+ echo "$COUNT images written: `since $start` s"
+ echo $COUNT >$FLEETDIR/count
+fi
+
+threads=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`
+[ $threads -lt 4 ] && threads=4
+for j in 1 $threads; do
+ start=`now`
+ find $FLEETDIR/images -name '*.bin' | \
+   $BINDIR/toshset-fleet -j $j >$FLEETDIR/report.$j || exit 1
+ echo "toshset-fleet -j $j: `since $start` s"
+done
+cmp -s $FLEETDIR/report.1 $FLEETDIR/report.$threads ||
+ echo "reports differ: $FLEETDIR/report.1 $FLEETDIR/report.$threads"
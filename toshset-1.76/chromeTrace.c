@@ -0,0 +1,222 @@
+/* chromeTrace.c -- Chrome trace-event export of a toshset run
+ *
+ * With -trace file, toshset records a timeline of the run: the startup
+ * probes, each feature action and query, the formatting of the output and
+ * every SCI/HCI call underneath them. At exit it is written to file as
+ * trace-event JSON, which chrome://tracing and Perfetto load directly.
+ *
+ * Events go into a buffer allocated once when tracing starts; recording
+ * one is a clock read and a few stores, and nothing is formatted or
+ * written until exit. Events beyond the buffer's size are counted and
+ * dropped.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<unistd.h>
+
+#include "chromeTrace.h"
+#include "smmTrace.h"
+
+#define CTRACE_EVENTS 32768
+
+enum { EV_BEGIN, EV_END, EV_SMM };
+
+typedef struct {
+  unsigned long long ts;      /* CLOCK_MONOTONIC, ns */
+  unsigned long long dur;     /* EV_SMM only */
+  const char*        name;
+  const char*        cat;
+  unsigned char      type;
+  unsigned char      iface;
+  unsigned short     ret;
+  unsigned int       eax,ebx;
+} CTraceEvent;
+
+int ctraceEnabled=0;
+
+static const char*  traceFile;
+static CTraceEvent* events;
+static int          numEvents=0;
+static int          depth=0;        /* spans begun and recorded, not ended */
+static int          droppedDepth=0; /* spans begun but dropped, not ended */
+static long         dropped=0;
+
+static unsigned long long
+tsNs(const struct timespec* t)
+{
+ return t->tv_sec*1000000000ULL + t->tv_nsec;
+} /* tsNs */
+
+/*
+ * Room is held back for the end of every open span, so that the spans
+ * which were recorded are always closed even once the buffer is full.
+ */
+static CTraceEvent*
+newEvent(int type)
+{
+ if ( numEvents>=CTRACE_EVENTS-depth-1 ) {
+   dropped++;
+   return 0;
+ }
+ events[numEvents].type = type;
+ return &events[numEvents++];
+} /* newEvent */
+
+void
+ctraceBegin(const char* name, const char* cat)
+{
+ struct timespec now;
+ CTraceEvent* e;
+
+ clock_gettime(CLOCK_MONOTONIC,&now);
+ if ( !(e=newEvent(EV_BEGIN)) ) {
+   droppedDepth++;
+   return;
+ }
+ depth++;
+ e->ts = tsNs(&now);
+ e->name = name;
+ e->cat = cat;
+} /* ctraceBegin */
+
+void
+ctraceEnd()
+{
+ struct timespec now;
+
+ if ( droppedDepth ) {
+   droppedDepth--;
+   return;
+ }
+ if ( !depth )
+   return;
+ clock_gettime(CLOCK_MONOTONIC,&now);
+ depth--;
+ events[numEvents].type = EV_END;
+ events[numEvents].ts = tsNs(&now);
+ numEvents++;
+} /* ctraceEnd */
+
+void
+ctraceSmm(int iface, const SMMRegisters* in, int ret,
+	  const struct timespec* start, const struct timespec* end)
+{
+ CTraceEvent* e;
+
+ if ( !(e=newEvent(EV_SMM)) )
+   return;
+ e->ts = tsNs(start);
+ e->dur = tsNs(end)-tsNs(start);
+ e->iface = iface;
+ e->ret = ret;
+ e->eax = in->eax & 0xffff;
+ e->ebx = in->ebx & 0xffff;
+} /* ctraceSmm */
+
+static void
+writeString(FILE* fp, const char* s)
+{
+ fputc('"',fp);
+ for ( ; s && *s ; s++)
+   if ( *s=='"' || *s=='\\' )
+     fprintf(fp,"\\%c",*s);
+   else if ( (unsigned char)*s<0x20 )
+     fprintf(fp,"\\u%04x",*s);
+   else
+     fputc(*s,fp);
+ fputc('"',fp);
+} /* writeString */
+
+static void
+ctraceWrite()
+{
+ unsigned long long t0;
+ int pid = getpid();
+ FILE* fp;
+ int i;
+
+ if ( !traceFile )
+   return;
+ if ( !(fp=fopen(traceFile,"w")) ) {
+   perror(traceFile);
+   return;
+ }
+ t0 = numEvents ? events[0].ts : 0;
+ for (i=0 ; i<numEvents ; i++)
+   if ( events[i].ts<t0 )
+     t0 = events[i].ts;
+ fprintf(fp,"{\"traceEvents\":[\n");
+ fprintf(fp,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+	 "\"args\":{\"name\":\"toshset\"}}",pid,pid);
+ for (i=0 ; i<numEvents ; i++) {
+   const CTraceEvent* e = &events[i];
+   double ts = (e->ts-t0)/1000.0;
+
+   fprintf(fp,",\n{");
+   switch ( e->type ) {
+    case EV_BEGIN:
+     fprintf(fp,"\"name\":");
+     writeString(fp,e->name);
+     fprintf(fp,",\"cat\":");
+     writeString(fp,e->cat);
+     fprintf(fp,",\"ph\":\"B\"");
+     break;
+    case EV_END:
+     fprintf(fp,"\"ph\":\"E\"");
+     break;
+    case EV_SMM:
+     fprintf(fp,"\"name\":\"%s 0x%04x\",\"cat\":\"smm\",\"ph\":\"X\","
+	     "\"dur\":%.3f,\"args\":{\"eax\":\"0x%04x\",\"ebx\":\"0x%04x\","
+	     "\"ret\":\"0x%02x\"}",
+	     smmIfaceName(e->iface),e->ebx,e->dur/1000.0,e->eax,e->ebx,e->ret);
+     break;
+   }
+   fprintf(fp,",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",ts,pid,pid);
+ }
+ fprintf(fp,"\n],\"displayTimeUnit\":\"ns\","
+	 "\"otherData\":{\"dropped_events\":%ld}}\n",dropped);
+ fclose(fp);
+ free(events);
+} /* ctraceWrite */
+
+/*
+ * Start recording, or, when already recording, just change the file the
+ * timeline is written to at exit.
+ */
+int
+ctraceOpen(const char* file)
+{
+ static int registered=0;
+
+ if ( !events &&
+      !(events=malloc(CTRACE_EVENTS*sizeof(CTraceEvent))) ) {
+   fprintf(stderr,"-trace: out of memory\n");
+   return 1;
+ }
+ traceFile = file;
+ ctraceEnabled = 1;
+ if ( !registered )
+   atexit(ctraceWrite);
+ registered = 1;
+ return 0;
+} /* ctraceOpen */
+
+/*
+ * Stop recording and drop what was recorded; no file is written.
+ */
+void
+ctraceCancel()
+{
+ ctraceEnabled = 0;
+ traceFile = 0;
+ free(events);
+ events = 0;
+ numEvents = depth = droppedDepth = 0;
+ dropped = 0;
+} /* ctraceCancel */
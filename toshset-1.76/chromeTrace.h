@@ -0,0 +1,50 @@
+
+#ifndef __chromeTrace_h__
+#define __chromeTrace_h__
+
+/*
+  timeline of a toshset run in Chrome trace-event JSON (-trace file).
+Spans are opened and closed with ctraceBegin()/ctraceEnd(); BIOS calls
+are added from smmCallEnd(). See chromeTrace.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+extern int ctraceEnabled;
+
+int  ctraceOpen(const char* file);
+void ctraceCancel();
+
+/* name and cat must stay valid until exit: they are written out then */
+void ctraceBegin(const char* name, const char* cat);
+void ctraceEnd();
+
+void ctraceSmm(int iface, const SMMRegisters* in, int ret,
+	       const struct timespec* start, const struct timespec* end);
+
+#ifdef __cplusplus
+}
+
+//
+// span covering the enclosing scope
+//
+class CTraceSpan {
+public:
+  CTraceSpan(const char* name, const char* cat)
+    { if ( ctraceEnabled ) ctraceBegin(name,cat); }
+  ~CTraceSpan()
+    { if ( ctraceEnabled ) ctraceEnd(); }
+};
+#endif
+
+#endif /* __chromeTrace_h__ */
@@ -116,6 +116,105 @@ int dHciFunction(SMMRegisters *reg)
  return (int) (reg->eax & 0xff00)>>8;
 } /* dHciFunction */
 
+/*
+ * The BIOS version, the machine id and the SCTT table all live in the
+ * BIOS ROM at 0xf0000-0xfffff. That range is mapped once, read-only, the
+ * first time either is asked for, and parsed in one go; the mapping is
+ * kept for the life of the program.
+ */
+#define BIOS_ROM_BASE 0xf0000
+#define BIOS_ROM_SIZE 0x10000
+
+typedef struct {
+  int version;
+  int id;
+} BiosIdent;
+
+static const unsigned char* rom=0;
+
+static int
+romWord(unsigned long address, unsigned short* w)
+{
+ if ( address<BIOS_ROM_BASE || address+2>BIOS_ROM_BASE+BIOS_ROM_SIZE )
+   return 0;
+ *w = *(const unsigned short*)(rom+address-BIOS_ROM_BASE);
+ return 1;
+} /* romWord */
+
+/*
+ * Machines reporting 0xfc2f keep their real id in the SCTT table, found
+ * by chasing pointers from an entry point in the BIOS.
+ */
+static int
+scttMachineID(int *id)
+{
+ unsigned short bx,cx;
+ unsigned char ah;
+
+ /* start by getting a pointer into the BIOS */
+
+ asm ("movw $0xc000,%%ax\n\t" \
+      "movw $0x0000,%%bx\n\t" \
+      "movw $0x0000,%%cx\n\t" \
+      "inb $0xb2,%%al\n\t" \
+      "movb %%ah,%%al\n" \
+      : "=b" (bx), "=a" (ah) : : "%ecx");
+
+ /* At this point in the Toshiba routines under MS Windows
+    the bx register holds 0xe6f5. However my code is producing
+    a different value! For the time being I will just fudge the
+    value. This has been verified on a Satellite Pro 430CDT,
+    Tecra 750CDT, Tecra 780DVD and Satellite 310CDT. */
+ bx = 0xe6f5;
+
+ /* now twiddle with our pointer a bit */
+
+ if ( !romWord(0x000f0000+bx,&cx) ||
+      !romWord(0x000f0009+bx+cx,&cx) ||
+      !romWord(0x000f000a+cx,&cx) )
+   return 0;
+
+ /* now construct our machine identification number */
+
+ *id = ((cx & 0xff)<<8)+((cx & 0xff00)>>8);
+ return 1;
+} /* scttMachineID */
+
+static const BiosIdent*
+biosIdent()
+{
+ static BiosIdent ident;
+ static int parsed=0;
+ const unsigned char* v;
+ void* mem;
+ int device;
+
+ if ( parsed )
+   return parsed>0 ? &ident : 0;
+ parsed = -1;
+
+ if ((device = open("/dev/mem", O_RDONLY))==-1)
+   return 0;
+ mem = mmap(0, BIOS_ROM_SIZE, PROT_READ, MAP_SHARED, device, BIOS_ROM_BASE);
+ close(device);
+ if ( mem==MAP_FAILED )
+   return 0;
+ rom = mem;
+
+ v = rom + 0xfe000 - BIOS_ROM_BASE;
+ ident.version = (((char) v[0x0009]-'0')*0x100) + 
+		 (((char) v[0x000b]-'0')*10)+((char) v[0x000c]-'0');
+
+ ident.id = (0x100*((int) rom[0xffffe - BIOS_ROM_BASE])) + 
+	    ((int) rom[0xffffa - BIOS_ROM_BASE]);
+ /* do we have a SCTTable machine identication number on our hands */
+ if ( ident.id==0xfc2f )
+   scttMachineID(&ident.id);
+
+ parsed = 1;
+ return &ident;
+} /* biosIdent */
+
 /*
  * Return the BIOS version of the laptop
  *
@@ -129,92 +228,20 @@ int dHciFunction(SMMRegisters *reg)
 int 
 dHciGetBiosVersion(void)
 {
- int id = 0;
- int device,major,minor;
- unsigned char *mem;
- if ((device = open("/dev/mem", O_RDWR))==-1)
-   return HCI_FAILURE;
- 
- mem = mmap(0, 0x1000, PROT_READ, MAP_SHARED, device, 0xfe000);
- if (mem==(unsigned char *)-1)
-   return HCI_FAILURE;
-
- major = (char) mem[0x0009]-'0';
- minor = (((char) mem[0x000b]-'0')*10)+((char) mem[0x000c]-'0');
-
- munmap(mem, 0x1000);
- close(device);
+ const BiosIdent* ident = biosIdent();
 
- id = (major*0x100)+minor;
-
- return id;
+ return ident ? ident->version : HCI_FAILURE;
 } /* dHciGetBiosVersion */
 
 
 int 
 dHciGetMachineID(int *id)
 {
- int device;
- unsigned char *mem;
- unsigned short bx;
- //	unsigned char fl;
-
- if ((device = open("/dev/mem", O_RDWR))==-1)
-   return HCI_FAILURE;
+ const BiosIdent* ident = biosIdent();
 
- mem = mmap(0, 0x100000, PROT_READ, MAP_SHARED, device,0); // 0xfe000);
- if (mem==(unsigned char *)-1)
+ if ( !ident )
    return HCI_FAILURE;
-
- *id = (0x100*((int) mem[0xffffe]))+((int) mem[0xffffa]);
- /* do we have a SCTTable machine identication number on our hands */
-
- if (*id==0xfc2f) {
-   unsigned char ah;
-   unsigned short cx;
-   unsigned long address;
-     
-   /* start by getting a pointer into the BIOS */
-
-   asm ("movw $0xc000,%%ax\n\t" \
-	"movw $0x0000,%%bx\n\t" \
-	"movw $0x0000,%%cx\n\t" \
-	"inb $0xb2,%%al\n\t" \
-	"movb %%ah,%%al\n" \
-	: "=b" (bx), "=a" (ah) : : "%ecx");
-
-   /* printf("bx: %x  mem: %x\n",bx,mem); */
-
-   /* At this point in the Toshiba routines under MS Windows
-      the bx register holds 0xe6f5. However my code is producing
-      a different value! For the time being I will just fudge the
-      value. This has been verified on a Satellite Pro 430CDT,
-      Tecra 750CDT, Tecra 780DVD and Satellite 310CDT. */
-   bx = 0xe6f5;
-
-   /* now twiddle with our pointer a bit */
-     
-   address = 0x000f0000+bx;
-   //		cx = readw(address);
-   //		  address = bx - 0xe000;
-   cx = *(unsigned short*)(mem+address);
-   address = 0x000f0009+bx+cx;
-   //		  address = 0x9+bx+cx - 0xe000;
-   //		cx = readw(address);
-   cx = *(unsigned short*)(mem+address);
-   address = 0x000f000a+cx;
-   //		  address = 0xa+cx - 0xe000;
-   //		cx = readw(address);
-   cx = *(unsigned short*)(mem+address);
-   
-   /* now construct our machine identification number */
-
-   *id = ((cx & 0xff)<<8)+((cx & 0xff00)>>8);
-
-   munmap(mem, 0x1000);
-   close(device);
-
- }
+ *id = ident->id;
  return HCI_SUCCESS;
 } /* dHciGetMachineID */
 
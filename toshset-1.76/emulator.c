@@ -0,0 +1,333 @@
+/* emulator.c -- in-process emulation of the Toshiba SCI/HCI BIOS
+ *
+ * This stands in for direct.c and /dev/toshiba so that toshset can be
+ * run, timed and regression tested on any Linux box. Each emulated model
+ * is a static table of the SCI and HCI registers it answers; anything not
+ * in the table returns NOT_SUPPORTED, just as a real BIOS would.
+ *
+ * The emulator is selected by detAccessMode() when TOSHSET_EMULATE is set
+ * to a model name. Two more variables tune it:
+ *
+ *   TOSHSET_EMULATE_LATENCY   microseconds added to every BIOS call
+ *   TOSHSET_EMULATE_BUSY      every Nth HCI call returns HCI_BUSY
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+
+#include "emulator.h"
+#include "transport.h"
+#include "hci.h"
+#include "sci.h"
+
+enum { EMU_SCI, EMU_HCI };
+
+enum {
+  EMU_VALUE,     /* a plain setting, returned in ecx */
+  EMU_BITS,      /* HCI_WIRELESS style: edx selects the bits to get/set */
+  EMU_STRING     /* HCI_OWNERSTRING style: 4 bytes at offset esi in edx */
+};
+
+typedef struct {
+  int            iface;
+  unsigned short reg;
+  int            kind;
+  unsigned int   value;    /* current setting, or bit state for EMU_BITS */
+  unsigned int   extra;    /* SCI: possible settings (edx); EMU_BITS:
+			      presence mask; EMU_STRING: max length */
+} EmuRegister;
+
+typedef struct {
+  const char*        name;
+  int                machineId;
+  int                bios;        /* major*0x100+minor */
+  int                sciVersion;
+  const char*        ownerString;
+  const EmuRegister* regs;
+  int                numRegs;
+} EmuModel;
+
+#define SCI_REG(r,v,p)    { EMU_SCI, r, EMU_VALUE,  v, p }
+#define HCI_REG(r,v)      { EMU_HCI, r, EMU_VALUE,  v, 0 }
+#define HCI_BITS(r,v,p)   { EMU_HCI, r, EMU_BITS,   v, p }
+#define HCI_STRING(r,len) { EMU_HCI, r, EMU_STRING, 0, len }
+
+#define EMU_STRING_MAX 512
+
+/* a late SCI 2.x / HCI machine with wireless and an owner string */
+static const EmuRegister tecra9100Regs[] = {
+  SCI_REG(SCI_BATTERY_SAVE   , SCI_FULL_POWER    , 0x0003),
+  SCI_REG(SCI_PROCESSING     , SCI_HIGH          , 0x0001),
+  SCI_REG(SCI_SLEEP_MODE     , SCI_OFF           , 0x0001),
+  SCI_REG(SCI_DISPLAY_AUTO   , SCI_TIME_05       , 0xffff),
+  SCI_REG(SCI_HDD_AUTO_OFF   , SCI_TIME_10       , 0xffff),
+  SCI_REG(SCI_CPU_CACHE      , SCI_ON            , 0x0001),
+  SCI_REG(SCI_SPEAKER_VOLUME , SCI_VOLUME_LOW    , 0x0003),
+  SCI_REG(SCI_SYSTEM_BEEP    , SCI_ON            , 0x0001),
+  SCI_REG(SCI_BATTERY_ALARM  , SCI_ON            , 0x0001),
+  SCI_REG(SCI_PANEL_ALARM    , SCI_OFF           , 0x0001),
+  SCI_REG(SCI_PANEL_POWER    , SCI_ON            , 0x0001),
+  SCI_REG(SCI_ALARM_DATE     , 0x0000            , 0x0001),
+  SCI_REG(SCI_ALARM_TIME     , SCI_ALARM_DISABLED, 0x0001),
+  SCI_REG(SCI_SYSTEM_AUTO    , SCI_TIME_DISABLED , 0xffff),
+  SCI_REG(SCI_BOOT_METHOD    , SCI_BOOT          , 0x0003),
+  SCI_REG(SCI_COOLING_METHOD , 0x0000            , 0x0002),
+  SCI_REG(SCI_HIBERNATION    , SCI_ENABLED       , 0x0001),
+  SCI_REG(SCI_LAN_CONTROLLER , SCI_ENABLED       , 0x0001),
+  SCI_REG(SCI_PARALLEL_PORT  , SCI_PARALLEL_ECP  , 0x0003),
+  SCI_REG(SCI_POINTING_DEVICE, 0x0000            , 0x0002),
+  SCI_REG(SCI_USB_LEGACY_MODE, SCI_ENABLED       , 0x0001),
+  SCI_REG(SCI_USB_FDD_EMULAT , SCI_DISABLED      , 0x0001),
+  SCI_REG(SCI_PASSWORD       , SCI_NOT_REGISTERED, 0x0001),
+  HCI_REG(HCI_BACKLIGHT      , HCI_ENABLE),
+  HCI_REG(HCI_FAN            , HCI_DISABLE),
+  HCI_REG(HCI_SELECT_STATUS  , HCI_ATAPI),
+  HCI_REG(HCI_LOCK_STATUS    , HCI_LOCKED),
+  HCI_REG(HCI_VIDEO_OUT      , HCI_INTERNAL),
+  HCI_REG(HCI_FLAT_PANEL     , (HCI_1400_1050<<8) | HCI_18BIT_TFT),
+  HCI_REG(HCI_LCD_BRIGHTNESS , 0x7<<13),
+  HCI_BITS(HCI_WIRELESS      , 0x00c1, 0x000f),
+  HCI_STRING(HCI_OWNERSTRING , EMU_STRING_MAX),
+};
+
+/* an early machine: SCI basics only, no wireless or owner string */
+static const EmuRegister libretto50Regs[] = {
+  SCI_REG(SCI_BATTERY_SAVE   , SCI_USER_SETTINGS , 0x0003),
+  SCI_REG(SCI_PROCESSING     , SCI_HIGH          , 0x0001),
+  SCI_REG(SCI_SLEEP_MODE     , SCI_ON            , 0x0001),
+  SCI_REG(SCI_DISPLAY_AUTO   , SCI_TIME_03       , 0xffff),
+  SCI_REG(SCI_HDD_AUTO_OFF   , SCI_TIME_05       , 0xffff),
+  SCI_REG(SCI_SPEAKER_VOLUME , SCI_VOLUME_LOW    , 0x0003),
+  SCI_REG(SCI_SYSTEM_BEEP    , SCI_ON            , 0x0001),
+  SCI_REG(SCI_PANEL_POWER    , SCI_ON            , 0x0001),
+  HCI_REG(HCI_BACKLIGHT      , HCI_ENABLE),
+  HCI_REG(HCI_VIDEO_OUT      , HCI_INTERNAL),
+  HCI_REG(HCI_FLAT_PANEL     , (HCI_640_480<<8) | HCI_12BIT_TFT),
+};
+
+#define NUM(a) ((int)(sizeof(a)/sizeof((a)[0])))
+
+static const EmuModel models[] = {
+  { "tecra9100" , 0xfc78, 0x0150, 0x0200, "Emulated Tecra 9100\n\r",
+    tecra9100Regs, NUM(tecra9100Regs) },
+  { "libretto50", 0xfc54, 0x0104, 0x0100, 0,
+    libretto50Regs, NUM(libretto50Regs) },
+};
+
+static const EmuModel* model=0;
+static EmuRegister*    regs=0;     /* writable copy of model->regs */
+static char            ownerString[EMU_STRING_MAX];
+static int             sciOpen=0;
+static long            latencyNs=0;
+static unsigned long   busyEvery=0;
+static unsigned long   hciCalls=0;
+
+int
+emulatorInit(const char* name)
+{
+ const char* env;
+ int i;
+
+ model = 0;
+ for (i=0 ; i<NUM(models) ; i++)
+   if ( strcmp(models[i].name,name)==0 )
+     model = &models[i];
+ if ( !model ) {
+   fprintf(stderr,"unknown emulated model: %s\nvalid models are:\n",name);
+   for (i=0 ; i<NUM(models) ; i++)
+     fprintf(stderr,"\t%s\n",models[i].name);
+   return 1;
+ }
+
+ regs = malloc(model->numRegs * sizeof(EmuRegister));
+ if ( !regs )
+   return 1;
+ memcpy(regs,model->regs,model->numRegs * sizeof(EmuRegister));
+
+ memset(ownerString,0,sizeof(ownerString));
+ if ( model->ownerString )
+   strncpy(ownerString,model->ownerString,sizeof(ownerString)-1);
+
+ if ( (env=getenv("TOSHSET_EMULATE_LATENCY")) )
+   latencyNs = atol(env) * 1000;
+ if ( (env=getenv("TOSHSET_EMULATE_BUSY")) )
+   busyEvery = strtoul(env,0,10);
+
+ return 0;
+} /* emulatorInit */
+
+/*
+ * every emulated call costs the configured BIOS latency
+ */
+static void
+emuDelay()
+{
+ struct timespec ts;
+
+ if ( latencyNs<=0 )
+   return;
+ ts.tv_sec  = latencyNs / 1000000000;
+ ts.tv_nsec = latencyNs % 1000000000;
+ while ( nanosleep(&ts,&ts) )
+   ;
+} /* emuDelay */
+
+static EmuRegister*
+emuFind(int iface, unsigned short reg)
+{
+ int i;
+
+ for (i=0 ; i<model->numRegs ; i++)
+   if ( regs[i].iface==iface && regs[i].reg==reg )
+     return &regs[i];
+ return 0;
+} /* emuFind */
+
+static int
+emuReturn(SMMRegisters *reg, int code)
+{
+ reg->eax = code<<8;
+ return code;
+} /* emuReturn */
+
+
+int
+eHciFunction(SMMRegisters *reg)
+{
+ EmuRegister* r;
+ int get;
+
+ emuDelay();
+
+ if ( busyEvery && ++hciCalls % busyEvery == 0 )
+   return emuReturn(reg,HCI_BUSY);
+
+ get = ( (reg->eax & 0xffff)==HCI_GET );
+ if ( !get && (reg->eax & 0xffff)!=HCI_SET )
+   return emuReturn(reg,HCI_FAILURE);
+
+ r = emuFind(EMU_HCI,reg->ebx & 0xffff);
+ if ( !r )
+   return emuReturn(reg,HCI_NOT_SUPPORTED);
+
+ switch ( r->kind ) {
+   case EMU_VALUE:
+     if ( get )
+       reg->ecx = r->value;
+     else
+       r->value = reg->ecx;
+     break;
+   case EMU_BITS:
+     if ( get )
+       reg->ecx = reg->edx ? r->value : r->extra;
+     else if ( reg->ecx )
+       r->value |= reg->edx;
+     else
+       r->value &= ~reg->edx;
+     break;
+   case EMU_STRING:
+     if ( get && reg->ecx==0 ) {
+       reg->ecx = r->extra<<16;
+       break;
+     }
+     if ( reg->ecx!=4 || reg->esi+4 > r->extra )
+       return emuReturn(reg,HCI_INPUT_ERROR);
+     if ( get )
+       memcpy(&reg->edx,ownerString+reg->esi,4);
+     else
+       memcpy(ownerString+reg->esi,&reg->edx,4);
+     break;
+ }
+ return emuReturn(reg,HCI_SUCCESS);
+} /* eHciFunction */
+
+int
+eHciGetBiosVersion()
+{
+ return model->bios;
+} /* eHciGetBiosVersion */
+
+int
+eHciGetMachineID(int *id)
+{
+ *id = model->machineId;
+ return HCI_SUCCESS;
+} /* eHciGetMachineID */
+
+
+int
+eSciSupportCheck(int *version)
+{
+ emuDelay();
+ *version = model->sciVersion;
+ return SCI_SUCCESS;
+} /* eSciSupportCheck */
+
+int
+eSciOpenInterface()
+{
+ emuDelay();
+ if ( sciOpen )
+   return SCI_ALREADY_OPEN;
+ sciOpen = 1;
+ return SCI_SUCCESS;
+} /* eSciOpenInterface */
+
+int
+eSciCloseInterface()
+{
+ emuDelay();
+ if ( !sciOpen )
+   return SCI_NOT_OPENED;
+ sciOpen = 0;
+ return SCI_SUCCESS;
+} /* eSciCloseInterface */
+
+int
+eSciGet(SMMRegisters *reg)
+{
+ EmuRegister* r;
+
+ emuDelay();
+ if ( !sciOpen )
+   return emuReturn(reg,SCI_NOT_OPENED);
+
+ r = emuFind(EMU_SCI,reg->ebx & 0xffff);
+ if ( !r )
+   return emuReturn(reg,SCI_NOT_SUPPORTED);
+
+ reg->ecx = r->value;
+ reg->edx = r->extra;
+ return emuReturn(reg,SCI_SUCCESS);
+} /* eSciGet */
+
+int
+eSciSet(SMMRegisters *reg)
+{
+ EmuRegister* r;
+
+ emuDelay();
+ if ( !sciOpen )
+   return emuReturn(reg,SCI_NOT_OPENED);
+
+ r = emuFind(EMU_SCI,reg->ebx & 0xffff);
+ if ( !r )
+   return emuReturn(reg,SCI_NOT_SUPPORTED);
+
+ r->value = reg->ecx & 0xffff;
+ return emuReturn(reg,SCI_SUCCESS);
+} /* eSciSet */
+
+const Transport emulatorTransport = {
+  "emulator", 0,
+  eHciFunction, eHciGetBiosVersion, eHciGetMachineID,
+  eSciSupportCheck, eSciOpenInterface, eSciCloseInterface,
+  eSciGet, eSciSet, 0
+};
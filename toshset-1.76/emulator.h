@@ -0,0 +1,36 @@
+
+#ifndef __emulator_h__
+#define __emulator_h__
+
+/*
+  in-process emulation of the Toshiba SCI/HCI BIOS interface. Selected by
+setting TOSHSET_EMULATE to a model name; see emulator.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+int emulatorInit(const char* model);
+
+int eHciFunction(SMMRegisters *reg);
+int eHciGetBiosVersion();
+int eHciGetMachineID(int *id);
+
+int eSciSupportCheck(int *version);
+int eSciOpenInterface();
+int eSciCloseInterface();
+int eSciGet(SMMRegisters *reg);
+int eSciSet(SMMRegisters *reg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __emulator_h__ */
@@ -0,0 +1,427 @@
+/* fleet.cc -- summarize the snapshots of many machines
+ *
+ * toshset-fleet reads images written by "toshset -snapshot" and reports,
+ * for every model (machine id), how often each setting takes each value,
+ * and how many machines differ from the majority of their model:
+ *
+ *   toshset-fleet [-j threads] [-outliers] [file...]
+ *
+ * With no files, their names are read from standard input, one per line,
+ * so a fleet of any size can be fed from find(1). -outliers also lists
+ * each setting in which a machine differs from its model's majority.
+ *
+ * A value is shown by the name toshset gives it, looked up by feature
+ * and index in the table both share (settingValues.c); the register it
+ * was read from follows where it is not the one the table expects, and
+ * stands alone for settings the table does not know.
+ *
+ * Files are mapped and decoded by a pool of threads, each taking the
+ * next unclaimed file from a shared cursor, so that no thread idles while
+ * files remain. Each thread counts into a table of its own, merged when
+ * all are done. Tables grow with the number of distinct (model, setting,
+ * value) triples, not with the number of files; names read from standard
+ * input are spooled to a temporary file for the second pass, which
+ * compares every machine with the majority, rather than kept in memory.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<pthread.h>
+
+#include "snapshot.h"
+#include "settingValues.h"
+#include "toshibaIDs.hh"
+
+#define FLEET_MAX_THREADS 256
+#define FLEET_LINE        4096
+
+//
+// counts keyed by (machine id, setting name, code, ecx), in an open
+// addressing hash table. A model's file count is kept under the empty
+// name; a setting's majority value under code and ecx of the entry.
+//
+struct Count {
+  unsigned int  machineId;
+  short         code;
+  unsigned int  ecx;
+  char          name[SNAPSHOT_NAME_LEN];
+  unsigned long n;                 // 0: free slot
+};
+
+struct CountTable {
+  Count*   slots;
+  unsigned size;                   // power of two
+  unsigned used;
+};
+
+static void
+tableInit(CountTable* t)
+{
+ t->size = 256;
+ t->used = 0;
+ t->slots = (Count*) calloc(t->size,sizeof(Count));
+ if ( !t->slots )
+   abort();
+} /* tableInit */
+
+static unsigned int
+hashKey(unsigned int id, const char* name, short code, unsigned int ecx,
+	int byValue)
+{
+ unsigned int h = 2166136261u ^ id;
+ for (const char* p=name ; *p ; p++)
+   h = (h ^ (unsigned char)*p) * 16777619u;
+ if ( byValue )
+   h = ((h ^ (unsigned short)code) * 16777619u ^ ecx) * 16777619u;
+ return h ^ (h>>15);
+} /* hashKey */
+
+// the slot for the key, claimed if insert is set and it is new; 0 if
+// it is not there. byValue=0 ignores code and ecx.
+static Count*
+tableFind(CountTable* t, unsigned int id, const char* name, short code,
+	  unsigned int ecx, int byValue, int insert)
+{
+ if ( insert && 2*(t->used+1) > t->size ) {
+   CountTable big;
+   big.size = 2*t->size;
+   big.used = 0;
+   big.slots = (Count*) calloc(big.size,sizeof(Count));
+   if ( !big.slots )
+     abort();
+   for (unsigned i=0 ; i<t->size ; i++)
+     if ( t->slots[i].n ) {
+       Count* c = &t->slots[i];
+       *tableFind(&big,c->machineId,c->name,c->code,c->ecx,byValue,1) = *c;
+     }
+   free(t->slots);
+   *t = big;
+ }
+
+ unsigned int mask = t->size-1;
+ for (unsigned int h=hashKey(id,name,code,ecx,byValue)&mask ; ; h=(h+1)&mask) {
+   Count* c = &t->slots[h];
+   if ( !c->n ) {
+     if ( !insert )
+       return 0;
+     c->machineId = id;
+     c->code = code;
+     c->ecx = ecx;
+     strncpy(c->name,name,sizeof(c->name)-1);
+     t->used++;
+     return c;                     // the caller makes n non-zero
+   }
+   if ( c->machineId==id && strcmp(c->name,name)==0 &&
+	(!byValue || (c->code==code && c->ecx==ecx)) )
+     return c;
+ }
+} /* tableFind */
+
+//
+// the file names, from the command line or standard input
+//
+struct Names {
+  char**          argv;
+  int             argc;
+  int             next;            // claimed with an atomic add
+  FILE*           in;              // or read from here, under lock
+  FILE*           spool;           // and copied here for the next pass
+  pthread_mutex_t lock;
+};
+
+// the next file name, in buf; 0 when there are none left
+static const char*
+nextName(Names* names, char* buf)
+{
+ if ( !names->in ) {
+   int i = __atomic_fetch_add(&names->next,1,__ATOMIC_RELAXED);
+   return i<names->argc ? names->argv[i] : 0;
+ }
+
+ const char* ret = 0;
+ pthread_mutex_lock(&names->lock);
+ while ( fgets(buf,FLEET_LINE,names->in) ) {
+   size_t len = strlen(buf);
+   if ( len && buf[len-1]=='\n' )
+     buf[--len] = 0;
+   if ( !len )
+     continue;
+   if ( names->spool )
+     fprintf(names->spool,"%s\n",buf);
+   ret = buf;
+   break;
+ }
+ pthread_mutex_unlock(&names->lock);
+ return ret;
+} /* nextName */
+
+static Names           names;
+static CountTable      modes;      // majority per (model, setting)
+static int             listOutliers=0;
+static pthread_mutex_t outLock = PTHREAD_MUTEX_INITIALIZER;
+
+// setting code of feature name, read as ecx, as text in buf
+static const char*
+valueText(char* buf, size_t size, const char* name, int code,
+	  unsigned int ecx)
+{
+ unsigned int reg;
+ const char* value = settingValueName(name,code,&reg);
+
+ if ( !value )
+   snprintf(buf,size,"%d=0x%04x",code,ecx);
+ else {
+   while ( *value==' ' )          // "auto-off time" pads its minutes
+     value++;
+   if ( reg!=ecx )
+     snprintf(buf,size,"%s (0x%04x)",value,ecx);
+   else
+     snprintf(buf,size,"%s",value);
+ }
+ return buf;
+} /* valueText */
+
+struct Worker {
+  pthread_t  thread;
+  CountTable counts;               // pass 1: values; pass 2: outliers
+  unsigned   bad;
+};
+
+// a valid image of file, or 1 with the reason printed (in the first
+// pass only)
+static int
+openImage(Snapshot* snap, const char* file)
+{
+ if ( snapshotOpen(snap,file) )
+   return 1;
+ if ( snapshotVerify(snap) ) {
+   if ( !snapshotQuiet )
+     fprintf(stderr,"%s: snapshot checksum does not match\n",file);
+   snapshotClose(snap);
+   return 1;
+ }
+ return 0;
+} /* openImage */
+
+static void*
+countPass(void* arg)
+{
+ Worker* w = (Worker*) arg;
+ char buf[FLEET_LINE];
+ const char* file;
+
+ while ( (file=nextName(&names,buf)) ) {
+   Snapshot snap;
+   if ( openImage(&snap,file) ) {
+     w->bad++;
+     continue;
+   }
+   unsigned int id = snap.header->machineId;
+   tableFind(&w->counts,id,"",0,0,1,1)->n++;
+   for (unsigned k=0 ; k<snap.header->count ; k++) {
+     const SnapshotEntry* e = &snap.entries[k];
+     if ( !e->name[0] || !memchr(e->name,0,sizeof(e->name)) )
+       continue;
+     tableFind(&w->counts,id,e->name,e->code,e->ecx,1,1)->n++;
+   }
+   snapshotClose(&snap);
+ }
+ return 0;
+} /* countPass */
+
+static void*
+outlierPass(void* arg)
+{
+ Worker* w = (Worker*) arg;
+ char buf[FLEET_LINE];
+ char line[FLEET_LINE+256];
+ char v1[64],v2[64];
+ const char* file;
+
+ while ( (file=nextName(&names,buf)) ) {
+   Snapshot snap;
+   if ( openImage(&snap,file) )
+     continue;
+   unsigned int id = snap.header->machineId;
+   int differs=0;
+   for (unsigned k=0 ; k<snap.header->count ; k++) {
+     const SnapshotEntry* e = &snap.entries[k];
+     if ( !e->name[0] || !memchr(e->name,0,sizeof(e->name)) )
+       continue;
+     const Count* m = tableFind(&modes,id,e->name,0,0,0,0);
+     if ( !m || (m->code==e->code && m->ecx==e->ecx) )
+       continue;
+     differs = 1;
+     if ( listOutliers ) {
+       snprintf(line,sizeof(line),"%s: %s: %s (most: %s)\n",file,e->name,
+		valueText(v1,sizeof(v1),e->name,e->code,e->ecx),
+		valueText(v2,sizeof(v2),m->name,m->code,m->ecx));
+       pthread_mutex_lock(&outLock);
+       fputs(line,stdout);
+       pthread_mutex_unlock(&outLock);
+     }
+   }
+   if ( differs )
+     tableFind(&w->counts,id,"",0,0,1,1)->n++;
+   snapshotClose(&snap);
+ }
+ return 0;
+} /* outlierPass */
+
+// run pass on numWorkers threads, each with an empty table
+static void
+runPass(void* (*pass)(void*), Worker* workers, int numWorkers)
+{
+ for (int i=0 ; i<numWorkers ; i++) {
+   tableInit(&workers[i].counts);
+   workers[i].bad = 0;
+   if ( pthread_create(&workers[i].thread,0,pass,&workers[i]) ) {
+     perror("pthread_create");
+     exit(1);
+   }
+ }
+ for (int i=0 ; i<numWorkers ; i++)
+   pthread_join(workers[i].thread,0);
+} /* runPass */
+
+// add every worker's counts into total, freeing them
+static void
+merge(CountTable* total, Worker* workers, int numWorkers)
+{
+ tableInit(total);
+ for (int i=0 ; i<numWorkers ; i++) {
+   CountTable* t = &workers[i].counts;
+   for (unsigned j=0 ; j<t->size ; j++)
+     if ( t->slots[j].n ) {
+       Count* c = &t->slots[j];
+       tableFind(total,c->machineId,c->name,c->code,c->ecx,1,1)->n += c->n;
+     }
+   free(t->slots);
+ }
+} /* merge */
+
+// by model, then setting (the model's file count first), then most
+// frequent value
+static int
+cmpCount(const void* a, const void* b)
+{
+ const Count* x = (const Count*) a;
+ const Count* y = (const Count*) b;
+ int r;
+ if ( x->machineId!=y->machineId )
+   return x->machineId<y->machineId ? -1 : 1;
+ if ( (r=strcmp(x->name,y->name)) )
+   return r;
+ if ( x->n!=y->n )
+   return x->n>y->n ? -1 : 1;
+ return x->code - y->code;
+} /* cmpCount */
+
+static void
+usage(const char* prog)
+{
+ fprintf(stderr,"usage: %s [-j threads] [-outliers] [file...]\n"
+	 "\twith no files, their names are read from standard input\n",prog);
+ exit(2);
+} /* usage */
+
+int
+main(int argc, char* argv[])
+{
+ int numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+ int i;
+
+ for (i=1 ; i<argc && argv[i][0]=='-' && argv[i][1] ; i++)
+   if ( strcmp(argv[i],"-j")==0 && i+1<argc )
+     numWorkers = atoi(argv[++i]);
+   else if ( strcmp(argv[i],"-outliers")==0 )
+     listOutliers = 1;
+   else
+     usage(argv[0]);
+ if ( numWorkers<1 )
+   numWorkers = 1;
+ if ( numWorkers>FLEET_MAX_THREADS )
+   numWorkers = FLEET_MAX_THREADS;
+
+ names.argv = argv+i;
+ names.argc = argc-i;
+ pthread_mutex_init(&names.lock,0);
+ if ( names.argc==0 ) {
+   names.in = stdin;
+   if ( !(names.spool=tmpfile()) ) {
+     perror("tmpfile");
+     return 1;
+   }
+ }
+
+ Worker* workers = new Worker[numWorkers];
+
+ // pass 1: count every value
+ CountTable totals;
+ runPass(countPass,workers,numWorkers);
+ unsigned bad=0;
+ for (i=0 ; i<numWorkers ; i++)
+   bad += workers[i].bad;
+ merge(&totals,workers,numWorkers);
+
+ Count* all = new Count[totals.used+1];
+ int num=0;
+ for (unsigned j=0 ; j<totals.size ; j++)
+   if ( totals.slots[j].n )
+     all[num++] = totals.slots[j];
+ free(totals.slots);
+ qsort(all,num,sizeof(Count),cmpCount);
+
+ // the first value of each setting is its model's majority
+ tableInit(&modes);
+ for (i=0 ; i<num ; i++)
+   if ( all[i].name[0] && (i==0 || all[i].machineId!=all[i-1].machineId ||
+			   strcmp(all[i].name,all[i-1].name)) )
+     *tableFind(&modes,all[i].machineId,all[i].name,0,0,0,1) = all[i];
+
+ // pass 2: compare each machine with its model
+ snapshotQuiet = 1;
+ names.next = 0;
+ if ( names.in ) {
+   fflush(names.spool);
+   rewind(names.spool);
+   names.in = names.spool;
+   names.spool = 0;
+ }
+ CountTable outliers;
+ runPass(outlierPass,workers,numWorkers);
+ merge(&outliers,workers,numWorkers);
+
+ unsigned long files=0;
+ char value[64];
+ for (i=0 ; i<num ; i++) {
+   const Count* c = &all[i];
+   if ( !c->name[0] ) {
+     const Count* o = tableFind(&outliers,c->machineId,"",0,0,1,0);
+     files = c->n;
+     printf("\n%s (machine id 0x%04x): %lu snapshots, %lu differing\n",
+	    toshibaModelName(c->machineId),c->machineId,files,o?o->n:0);
+     continue;
+   }
+   if ( i==0 || strcmp(c->name,all[i-1].name) )
+     printf("  %-26s",c->name);
+   else
+     printf("  %-26s","");
+   printf(" %-30s %8lu %5.1f%%\n",
+	  valueText(value,sizeof(value),c->name,c->code,c->ecx),c->n,
+	  files ? 100.0*c->n/files : 0.0);
+ }
+ if ( bad )
+   fprintf(stderr,"%u files skipped\n",bad);
+
+ delete [] all;
+ delete [] workers;
+ return 0;
+} /* main */
@@ -0,0 +1,129 @@
+/* fleetgen.c -- synthetic snapshot images for timing toshset-fleet
+ *
+ *   fleetgen dir count template...
+ *
+ * writes count images to dir/NN/mNNNNNN.bin, spread over 100
+ * subdirectories, each a copy of the templates in turn (images written by
+ * "toshset -snapshot"). One image in twenty has one setting moved to the
+ * next value in its feature's list, so that there are outliers to find.
+ * The choice is seeded, so the same arguments give the same fleet.
+ *
+ * Used by bench-fleet.sh; not installed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+
+#include "snapshot.h"
+#include "settingValues.h"
+
+#define FLEETGEN_DIRS      100
+#define FLEETGEN_MAX_TMPL  16
+#define FLEETGEN_OUTLIERS  20     /* one image in this many */
+
+typedef struct {
+  SnapshotHeader header;
+  SnapshotEntry* entries;
+} Template;
+
+static int
+loadTemplate(Template* t, const char* file)
+{
+ Snapshot snap;
+
+ if ( snapshotOpen(&snap,file) )
+   return 1;
+ if ( snapshotVerify(&snap) || !snap.header->count ) {
+   fprintf(stderr,"%s: not a usable template\n",file);
+   snapshotClose(&snap);
+   return 1;
+ }
+ t->header = *snap.header;
+ t->entries = malloc(t->header.count*sizeof(SnapshotEntry));
+ if ( !t->entries ) {
+   snapshotClose(&snap);
+   return 1;
+ }
+ memcpy(t->entries,snap.entries,t->header.count*sizeof(SnapshotEntry));
+ snapshotClose(&snap);
+ return 0;
+} /* loadTemplate */
+
+/* move entry e to the next setting in its list, or the first */
+static void
+perturb(SnapshotEntry* e)
+{
+ unsigned int reg;
+
+ if ( settingValueName(e->name,e->code+1,&reg) )
+   e->code++;
+ else if ( e->code>0 && settingValueName(e->name,0,&reg) )
+   e->code = 0;
+ else
+   return;
+ e->ecx = reg;
+} /* perturb */
+
+int
+main(int argc, char* argv[])
+{
+ Template tmpl[FLEETGEN_MAX_TMPL];
+ SnapshotEntry* entries;
+ char path[4096];
+ unsigned int seed = 1;
+ unsigned int maxCount = 0;
+ long count,i;
+ int numTmpl,t;
+
+ if ( argc<4 || (count=atol(argv[2]))<=0 ||
+      argc-3>FLEETGEN_MAX_TMPL ) {
+   fprintf(stderr,"usage: %s dir count template...\n",argv[0]);
+   return 2;
+ }
+ numTmpl = argc-3;
+ for (t=0 ; t<numTmpl ; t++) {
+   if ( loadTemplate(&tmpl[t],argv[t+3]) )
+     return 1;
+   if ( tmpl[t].header.count>maxCount )
+     maxCount = tmpl[t].header.count;
+ }
+ entries = malloc(maxCount*sizeof(SnapshotEntry));
+ if ( !entries )
+   return 1;
+
+ if ( mkdir(argv[1],0755) && errno!=EEXIST ) {
+   perror(argv[1]);
+   return 1;
+ }
+ for (i=0 ; i<FLEETGEN_DIRS && i<count ; i++) {
+   snprintf(path,sizeof(path),"%s/%02ld",argv[1],i);
+   if ( mkdir(path,0755) && errno!=EEXIST ) {
+     perror(path);
+     return 1;
+   }
+ }
+
+ for (i=0 ; i<count ; i++) {
+   const Template* tp = &tmpl[i%numTmpl];
+   unsigned int n = tp->header.count;
+   memcpy(entries,tp->entries,n*sizeof(SnapshotEntry));
+   if ( rand_r(&seed)%FLEETGEN_OUTLIERS==0 )
+     perturb(&entries[rand_r(&seed)%n]);
+   snprintf(path,sizeof(path),"%s/%02ld/m%06ld.bin",argv[1],
+	    i%FLEETGEN_DIRS,i);
+   if ( snapshotWrite(path,tp->header.machineId,tp->header.biosVersion,
+		      entries,n) )
+     return 1;
+ }
+ free(entries);
+ return 0;
+} /* main */
@@ -72,49 +72,65 @@ static const char rcsid[]="$Id: hci.c,v 1.7 2004-04-20 20:42:21 schwitrs Exp $";
 #include <signal.h>
 
 #include "hci.h"
-#include "kernelInterface.h"
-#include "direct.h"
+#include "transport.h"
+#include "smmTrace.h"
+#include "smmRetry.h"
+#include "smmCache.h"
 
-static int id=0xfc2f;
+/*
+ * Every HCI call goes through here, to the selected transport, so that
+ * it can be recorded and timed.
+ */
+static int hciCall(int iface, SMMRegisters *reg)
+{
+ SmmCall call;
+ int ret;
+
+ smmCallBegin(&call,iface,reg);
+ ret = transport->hciFunction(reg);
+ return smmCallEnd(&call,reg,ret);
+}
 
 int HciFunction(SMMRegisters *reg)
 {
- if ( accessMode==ACCESS_DIRECT ) 
-   return dHciFunction(reg);
- else
-   return smmAccess(reg);
+ SMMRegisters in;
+ int ret;
+
+ if ( (reg->eax & 0xffff)!=HCI_GET ) {
+   smmCacheFlush();
+   return smmRetry(SMM_HCI,reg,hciCall);
+ }
+ if ( (ret=smmCacheGet(SMM_HCI,reg))>=0 )
+   return ret;
+ in = *reg;
+ ret = smmRetry(SMM_HCI,reg,hciCall);
+ smmCachePut(SMM_HCI,&in,reg,ret);
+ return ret;
 }
 
 
 int 
 HciGetBiosVersion()
 {
- id = 0;
- if ( accessMode==ACCESS_DIRECT ) {
-   id = dHciGetBiosVersion();
- } else {
-   ToshProcInfo procInfo;
-   if ( !procAccess(&procInfo) )
-     return HCI_FAILURE;
-   id = (procInfo.major*0x100)+procInfo.minor;
- }
+ SMMRegisters reg = { 0 };
+ SmmCall call;
+ int ret;
 
- return id;
+ smmCallBegin(&call,SMM_HCI_BIOS,&reg);
+ reg.ecx = ret = transport->hciGetBiosVersion();
+ return smmCallEnd(&call,&reg,ret);
 } /* HciGetBiosVersion */
 
 
 int 
 HciGetMachineID(int *id)
 {
- if ( accessMode==ACCESS_DIRECT ) {
-   return dHciGetMachineID(id);
- } else {
-   ToshProcInfo procInfo;
-   if ( procAccess(&procInfo) )
-     *id = procInfo.id;
-   else 
-     return HCI_FAILURE;
- }
- return HCI_SUCCESS;
-} /* HciGetMachineID */
+ SMMRegisters reg = { 0 };
+ SmmCall call;
+ int ret;
 
+ smmCallBegin(&call,SMM_HCI_ID,&reg);
+ ret = transport->hciGetMachineID(id);
+ reg.ecx = *id;
+ return smmCallEnd(&call,&reg,ret);
+} /* HciGetMachineID */
@@ -1,5 +1,11 @@
 
 #include "kernelInterface.h"
+#include "transport.h"
+#include "emulator.h"
+#include "sysfs.h"
+#include "smmTrace.h"
+#include "hci.h"
+#include "sci.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -9,16 +15,41 @@
 #include <sys/ioctl.h>
 #include <stdlib.h>
 
-int accessMode=ACCESS_DIRECT;
-
 void
 detAccessMode()
 {
- accessMode=ACCESS_DIRECT;
+ const char* emulate;
+ const char* file;
+
+ if ( (file=getenv("TOSHSET_RECORD")) && smmRecordOpen(file) )
+   exit(1);
+
+ transport=&directTransport;
+ if ( (file=getenv("TOSHSET_REPLAY")) ) {
+   if ( smmReplayOpen(file) )
+     exit(1);
+   transport=&replayTransport;
+   return;
+ }
+ if ( (emulate=getenv("TOSHSET_EMULATE")) ) {
+   if ( emulatorInit(emulate) )
+     exit(1);
+   transport=&emulatorTransport;
+   return;
+ }
+#ifdef USE_KERNEL_INTERFACE
+ if ( 0==access(TOSH_PROC, R_OK) ) {
+   transport=&kernelTransport;
+   return;
+ }
+#endif /* USE_KERNEL_INTERFACE */
+ // machines without /dev/toshiba may still have the tos1900 driver
+ if ( sysfsInit()==0 ) {
+   transport=&sysfsTransport;
+   return;
+ }
 #ifdef USE_KERNEL_INTERFACE
- if ( 0==access(TOSH_PROC, R_OK) )
-   accessMode=ACCESS_KERNEL;
- else if ( 0==access("/proc/acpi",R_OK) ) {
+ if ( 0==access("/proc/acpi",R_OK) ) {
    fprintf(stderr,"required kernel toshiba support not enabled.\n");
    exit(1);
  }
@@ -55,12 +86,16 @@ procAccess(ToshProcInfo* proc)
  return 1;
 } /* procAccess */
 
+/*
+ * /dev/toshiba is opened on first use and kept open for the rest of the
+ * run.
+ */
 int 
 smmAccess(SMMRegisters *regs)
 {
- int fd;
+ static int fd=-1;
  
- if ((fd=open(TOSH_DEVICE, O_RDWR))<0) {
+ if ( fd<0 && (fd=open(TOSH_DEVICE, O_RDWR))<0 ) {
    printf("can't open %s: do you have read/write access?\n",
 	  TOSH_DEVICE);
    //fprintf(stderr,
@@ -69,20 +104,104 @@ smmAccess(SMMRegisters *regs)
    return 1;
  }
 
- if (access(TOSH_PROC, R_OK)) {
-   close(fd);
+ if (ioctl(fd, TOSH_SMM, regs)<0)
    return 1;
- }
- if (ioctl(fd, TOSH_SMM, regs)<0) {
-   close(fd);
-   return 1;
- }
-
- close(fd);
 
  return (int) (regs->eax & 0xff00)>>8;
 } /* smmAccess */
 
+/*
+ * the /dev/toshiba backend
+ */
+
+static int 
+kHciFunction(SMMRegisters *reg)
+{
+ return smmAccess(reg);
+} /* kHciFunction */
+
+static int 
+kHciGetBiosVersion()
+{
+ ToshProcInfo procInfo;
+ if ( !procAccess(&procInfo) )
+   return HCI_FAILURE;
+ return (procInfo.major*0x100)+procInfo.minor;
+} /* kHciGetBiosVersion */
+
+static int 
+kHciGetMachineID(int *id)
+{
+ ToshProcInfo procInfo;
+ if ( !procAccess(&procInfo) )
+   return HCI_FAILURE;
+ *id = procInfo.id;
+ return HCI_SUCCESS;
+} /* kHciGetMachineID */
+
+static int 
+kSciSupportCheck(int *version)
+{
+ SMMRegisters regs;
+
+ regs.eax = 0xf0f0;
+ regs.ebx = 0x0000;
+ regs.ecx = 0x0000;
+ regs.edx = 0x0000;
+
+ if ( smmAccess(&regs) != 1 ) {
+   *version = (int) regs.edx;
+   return (int) (regs.eax & 0xff00)>>8;
+ }
+ return SCI_FAILURE;
+} /* kSciSupportCheck */
+
+static int 
+kSciInterface(unsigned int eax)
+{
+ SMMRegisters regs;
+ regs.eax = eax;
+ regs.ebx = 0x0000;
+ regs.ecx = 0x0000;
+
+ if ( smmAccess(&regs) != 1 )
+   return (int) (regs.eax & 0xff00)>>8;
+ return SCI_FAILURE;
+} /* kSciInterface */
+
+static int kSciOpenInterface()  { return kSciInterface(0xf1f1); }
+static int kSciCloseInterface() { return kSciInterface(0xf2f2); }
+
+static int 
+kSciGet(SMMRegisters *reg)
+{
+ reg->eax = 0xf3f3;
+
+ if ( smmAccess(reg) != 1 ) {
+   reg->ebx  &= 0xffff;
+   reg->ecx  &= 0xffff;
+   reg->edx  &= 0xffff;
+   return (int) (reg->eax & 0xff00)>>8;
+ }
+ return SCI_FAILURE;
+} /* kSciGet */
+
+static int 
+kSciSet(SMMRegisters *reg)
+{
+ reg->eax = 0xf4f4;
+ if ( smmAccess(reg) != 1 ) 
+   return (int) (reg->eax & 0xff00)>>8;
+ return SCI_FAILURE;
+} /* kSciSet */
+
+const Transport kernelTransport = {
+  "kernel", 0,
+  kHciFunction, kHciGetBiosVersion, kHciGetMachineID,
+  kSciSupportCheck, kSciOpenInterface, kSciCloseInterface,
+  kSciGet, kSciSet, 0
+};
+
 #else 
 int smmAccess(SMMRegisters* regs) { return 1; } /* failure */
 int procAccess(ToshProcInfo* proc) { return 0; }
@@ -22,8 +22,7 @@ typedef struct {
 int procAccess(ToshProcInfo* proc);
 int smmAccess(SMMRegisters *regs);
 
-enum { ACCESS_DIRECT, ACCESS_KERNEL };
-extern int accessMode;
+// choose the transport (see transport.h)
 void detAccessMode();
 
 
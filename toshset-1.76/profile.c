@@ -0,0 +1,212 @@
+/* profile.c -- named settings profiles
+ *
+ * A profile file holds named lists of toshset options:
+ *
+ *   # switch with "toshset -profile battery"
+ *   [battery]
+ *   -bs long  -cpu slow  -inten 3
+ *   -ostring "on battery"
+ *
+ *   [docked]
+ *   -bs full  -cpu fast  -inten 7
+ *
+ * Options are separated by white space and may span lines; double quotes
+ * group an argument containing spaces, and # starts a comment. The file
+ * is read with a single read() and tokenized in place: tokens are NUL
+ * terminated where they lie in the buffer and handed out as pointers
+ * into it, so nothing is copied.
+ *
+ * The file is $TOSHSET_PROFILES, else ~/.toshsetrc, else
+ * /etc/toshset.conf.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdarg.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<pwd.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+
+#include "profile.h"
+
+static void
+printStderr(const char* text)
+{
+ fputs(text,stderr);
+} /* printStderr */
+
+void (*profileMessage)(const char* text) = printStderr;
+
+/* an error message, passed to profileMessage */
+static void
+report(const char* fmt, ...)
+{
+ char buf[1024];
+ va_list ap;
+
+ va_start(ap,fmt);
+ vsnprintf(buf,sizeof(buf),fmt,ap);
+ va_end(ap);
+ profileMessage(buf);
+} /* report */
+
+const char*
+profileFile()
+{
+ static char path[1024];
+ const char* env;
+ const char* home;
+ struct passwd* pw;
+
+ if ( (env=getenv("TOSHSET_PROFILES")) )
+   return env;
+ home = getenv("HOME");
+ if ( !home && (pw=getpwuid(getuid())) )
+   home = pw->pw_dir;
+ if ( home ) {
+   snprintf(path,sizeof(path),"%s/.toshsetrc",home);
+   if ( access(path,R_OK)==0 )
+     return path;
+ }
+ return "/etc/toshset.conf";
+} /* profileFile */
+
+static char*
+readFile(const char* file)
+{
+ struct stat st;
+ char* buf;
+ int fd;
+ ssize_t n;
+
+ if ( (fd=open(file,O_RDONLY))<0 ) {
+   report("%s: %s\n",file,strerror(errno));
+   return 0;
+ }
+ if ( fstat(fd,&st) || !(buf=malloc(st.st_size+1)) ) {
+   close(fd);
+   return 0;
+ }
+ n = read(fd,buf,st.st_size);
+ close(fd);
+ if ( n<0 ) {
+   report("%s: %s\n",file,strerror(errno));
+   free(buf);
+   return 0;
+ }
+ buf[n] = 0;
+ return buf;
+} /* readFile */
+
+/*
+ * The next token at *p, NUL terminated in place, with *p moved past it;
+ * NULL at the end of the text.
+ */
+static char*
+nextToken(char** p)
+{
+ char* s = *p;
+ char* tok;
+
+ for (;;) {
+   while ( *s==' ' || *s=='\t' || *s=='\n' || *s=='\r' )
+     s++;
+   if ( *s!='#' )
+     break;
+   while ( *s && *s!='\n' )
+     s++;
+ }
+ if ( !*s ) {
+   *p = s;
+   return 0;
+ }
+
+ if ( *s=='"' ) {
+   tok = ++s;
+   while ( *s && *s!='"' )
+     s++;
+ } else {
+   tok = s;
+   while ( *s && *s!=' ' && *s!='\t' && *s!='\n' && *s!='\r' )
+     s++;
+ }
+ if ( *s )
+   *s++ = 0;
+ *p = s;
+ return tok;
+} /* nextToken */
+
+/*
+ * Split line in place into at most max tokens, as in a profile; return
+ * their count.
+ */
+int
+profileSplit(char* line, const char** toks, int max)
+{
+ char* tok;
+ int n=0;
+
+ while ( n<max && (tok=nextToken(&line)) )
+   toks[n++] = tok;
+ return n;
+} /* profileSplit */
+
+/*
+ * Return the tokens of profile name in file, NULL terminated, with their
+ * count in *num; NULL if the file can't be read or has no such profile.
+ * The tokens point into a buffer which is kept for the life of the
+ * program.
+ */
+const char**
+profileFind(const char* file, const char* name, int* num)
+{
+ const char** toks=0;
+ int n=0, size=0;
+ int inProfile=0, found=0;
+ char* buf;
+ char* p;
+ char* tok;
+
+ if ( !(buf=readFile(file)) )
+   return 0;
+
+ for (p=buf ; (tok=nextToken(&p)) ; ) {
+   if ( tok[0]=='[' && tok[strlen(tok)-1]==']' ) {
+     tok[strlen(tok)-1] = 0;
+     inProfile = strcmp(tok+1,name)==0;
+     found |= inProfile;
+     continue;
+   }
+   if ( !inProfile )
+     continue;
+
+   if ( n+1>=size ) {
+     size = size ? 2*size : 32;
+     toks = realloc(toks,size*sizeof(*toks));
+     if ( !toks )
+       return 0;
+   }
+   toks[n++] = tok;
+ }
+
+ if ( !found ) {
+   report("%s: no profile [%s]\n",file,name);
+   free(toks);
+   free(buf);
+   return 0;
+ }
+ if ( !toks && !(toks=malloc(sizeof(*toks))) )
+   return 0;
+ toks[n] = 0;
+ *num = n;
+ return toks;
+} /* profileFind */
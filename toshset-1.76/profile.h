@@ -0,0 +1,24 @@
+
+#ifndef __profile_h__
+#define __profile_h__
+
+/*
+  named settings profiles for -profile; see profile.c for the file format.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char* profileFile();
+const char** profileFind(const char* file, const char* name, int* num);
+int profileSplit(char* line, const char** toks, int max);
+
+/* where error messages go: stderr, unless the program points it elsewhere */
+extern void (*profileMessage)(const char* text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __profile_h__ */
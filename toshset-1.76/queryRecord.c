@@ -0,0 +1,251 @@
+/* queryRecord.c -- JSON lines and binary records for -o
+ *
+ * "-o json" writes one JSON object per feature and line:
+ *
+ *   {"name":"fan","flag":"-fan","iface":"hci","ebx":4,"ecx":1,"edx":0,
+ *    "status":0,"code":1,"value":"on"}
+ *
+ * with "error" in place of "value" when the read failed. flag, code and
+ * value are null where the feature has none.
+ *
+ * "-o bin" writes an 8 byte header followed by fixed 128 byte records,
+ * both in host byte order, so a reader can step through them without
+ * parsing:
+ *
+ *   header:  "TSQR"  u16 version  u16 record size
+ *   record:  u8 iface  u8 pad  u16 status  s16 code  u16 reserved
+ *            u32 ebx  u32 ecx  u32 edx
+ *            char name[40]  char flag[16]  char value[52]
+ *
+ * iface is 0 (none), 1 (SCI) or 2 (HCI); the strings are NUL padded and
+ * cut short where they do not fit. Fields are only ever added in place
+ * of the reserved ones, or at the end with a new version.
+ *
+ * Records are encoded straight into one buffer, grown as needed and kept
+ * from one query to the next, which the caller writes out in one go.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdlib.h>
+#include<string.h>
+
+#include "queryRecord.h"
+
+#define RECORD_MAGIC   "TSQR"
+#define RECORD_VERSION 1
+
+typedef struct {
+  char           magic[4];
+  unsigned short version;
+  unsigned short size;
+} BinHeader;
+
+typedef struct {
+  unsigned char  iface;
+  unsigned char  pad;
+  unsigned short status;
+  short          code;
+  unsigned short reserved;
+  unsigned int   ebx,ecx,edx;
+  char           name[40];
+  char           flag[16];
+  char           value[52];
+} BinRecord;
+
+typedef char binRecordIs128[sizeof(BinRecord)==128 ? 1 : -1];
+
+static char*  buf;
+static size_t len,cap;
+static int    format;
+
+static const char* ifaceNames[] = { 0, "sci", "hci" };
+
+/*
+ * room for n more bytes
+ */
+static char*
+reserve(size_t n)
+{
+ if ( len+n>cap ) {
+   size_t c = cap ? cap : 4096;
+   char* p;
+   while ( c<len+n )
+     c *= 2;
+   if ( !(p=realloc(buf,c)) )
+     abort();
+   buf = p;
+   cap = c;
+ }
+ return buf+len;
+} /* reserve */
+
+static void
+putMem(const char* s, size_t n)
+{
+ memcpy(reserve(n),s,n);
+ len += n;
+} /* putMem */
+
+#define putLit(s) putMem(s,sizeof(s)-1)
+
+static void
+putInt(long v)
+{
+ char tmp[24];
+ char* p = tmp+sizeof(tmp);
+ unsigned long u = v<0 ? -(unsigned long)v : (unsigned long)v;
+
+ do
+   *--p = '0' + u%10;
+ while ( u/=10 );
+ if ( v<0 )
+   *--p = '-';
+ putMem(p,tmp+sizeof(tmp)-p);
+} /* putInt */
+
+/*
+ * s as a JSON string, or null. The owner and BIOS strings need not be
+ * UTF-8, so bytes from 0x80 up are read as Latin-1 and escaped, which
+ * keeps every line valid JSON.
+ */
+static void
+putString(const char* s, int n)
+{
+ static const char hex[] = "0123456789abcdef";
+ const char* end;
+ const char* run;
+ char* p;
+
+ if ( !s ) {
+   putLit("null");
+   return;
+ }
+ end = s + (n<0 ? strlen(s) : (size_t)n);
+ putLit("\"");
+ for (run=s ; s<end ; s++) {
+   unsigned char c = *s;
+   if ( c>=0x20 && c<0x80 && c!='"' && c!='\\' )
+     continue;
+   putMem(run,s-run);
+   run = s+1;
+   switch ( c ) {
+     case '"' : putLit("\\\""); break;
+     case '\\': putLit("\\\\"); break;
+     case '\n': putLit("\\n"); break;
+     case '\t': putLit("\\t"); break;
+     default:
+       p = reserve(6);
+       memcpy(p,"\\u00",4);
+       p[4] = hex[c>>4];
+       p[5] = hex[c&0xf];
+       len += 6;
+   }
+ }
+ putMem(run,s-run);
+ putLit("\"");
+} /* putString */
+
+static void
+putJson(const QueryRecord* r)
+{
+ putLit("{\"name\":");
+ putString(r->name,-1);
+ putLit(",\"flag\":");
+ putString(r->flag,-1);
+ putLit(",\"iface\":");
+ putString(ifaceNames[r->iface],-1);
+ putLit(",\"ebx\":");
+ putInt(r->ebx);
+ putLit(",\"ecx\":");
+ putInt(r->ecx);
+ putLit(",\"edx\":");
+ putInt(r->edx);
+ putLit(",\"status\":");
+ putInt(r->status);
+ if ( r->status ) {
+   putLit(",\"error\":");
+   putString(r->error,-1);
+ } else {
+   putLit(",\"code\":");
+   if ( r->code<0 )
+     putLit("null");
+   else
+     putInt(r->code);
+   putLit(",\"value\":");
+   putString(r->value,r->valueLen);
+ }
+ putLit("}\n");
+} /* putJson */
+
+static void
+copyField(char* field, size_t size, const char* s, int n)
+{
+ size_t l;
+
+ if ( !s )
+   return;
+ l = n<0 ? strlen(s) : (size_t)n;
+ memcpy(field,s,l<size ? l : size-1);
+} /* copyField */
+
+static void
+putBin(const QueryRecord* r)
+{
+ BinRecord* b = (BinRecord*) reserve(sizeof(BinRecord));
+
+ memset(b,0,sizeof(*b));
+ b->iface  = r->iface;
+ b->status = r->status;
+ b->code   = r->code;
+ b->ebx    = r->ebx;
+ b->ecx    = r->ecx;
+ b->edx    = r->edx;
+ copyField(b->name,sizeof(b->name),r->name,-1);
+ copyField(b->flag,sizeof(b->flag),r->flag,-1);
+ if ( !r->status )
+   copyField(b->value,sizeof(b->value),r->value,r->valueLen);
+ len += sizeof(BinRecord);
+} /* putBin */
+
+int
+outputFormatFor(const char* s)
+{
+ if ( strcmp(s,"text")==0 ) return OUTPUT_TEXT;
+ if ( strcmp(s,"json")==0 ) return OUTPUT_JSON;
+ if ( strcmp(s,"bin")==0 )  return OUTPUT_BIN;
+ return -1;
+} /* outputFormatFor */
+
+void
+recordBegin(int f)
+{
+ format = f;
+ len = 0;
+ if ( format==OUTPUT_BIN ) {
+   BinHeader* h = (BinHeader*) reserve(sizeof(BinHeader));
+   memcpy(h->magic,RECORD_MAGIC,4);
+   h->version = RECORD_VERSION;
+   h->size = sizeof(BinRecord);
+   len += sizeof(BinHeader);
+ }
+} /* recordBegin */
+
+void
+recordPut(const QueryRecord* r)
+{
+ if ( format==OUTPUT_BIN )
+   putBin(r);
+ else
+   putJson(r);
+} /* recordPut */
+
+const char*
+recordData(size_t* n)
+{
+ *n = len;
+ return buf;
+} /* recordData */
@@ -0,0 +1,48 @@
+
+#ifndef __queryRecord_h__
+#define __queryRecord_h__
+
+/*
+  machine-readable -q output: one record per feature, as JSON lines or
+as fixed-size binary records, encoded into a single buffer. See
+queryRecord.c for the binary layout.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include<stddef.h>
+
+enum { OUTPUT_TEXT, OUTPUT_JSON, OUTPUT_BIN };
+
+enum { RECORD_NONE, RECORD_SCI, RECORD_HCI };
+
+typedef struct {
+  const char*  name;
+  const char*  flag;      /* option which sets the feature, or 0 */
+  int          iface;     /* RECORD_SCI, RECORD_HCI, or RECORD_NONE if
+			     the feature is not read from the BIOS */
+  unsigned int ebx,ecx,edx;
+  int          status;    /* 0, or the SCI/HCI error code */
+  const char*  error;     /* name of status, when not 0 */
+  int          code;      /* index of the setting in the feature's list,
+			     or -1 */
+  const char*  value;     /* the setting as -q shows it, or 0 */
+  int          valueLen;  /* -1: value is NUL terminated */
+} QueryRecord;
+
+// the format named s, or -1
+int  outputFormatFor(const char* s);
+
+// empty the buffer and start a stream of records in format
+void recordBegin(int format);
+void recordPut(const QueryRecord* r);
+// everything encoded since recordBegin()
+const char* recordData(size_t* len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __queryRecord_h__ */
@@ -108,120 +108,82 @@ static const char rcsid[]="$Id: sci.c,v 1.9 2004-04-30 18:18:36 schwitrs Exp $";
 #include<sys/mman.h>
 
 #include"sci.h"
-#include "kernelInterface.h"
-#include "direct.h"
+#include "transport.h"
+#include "smmTrace.h"
+#include "smmRetry.h"
+#include "smmCache.h"
 
 
 /*
- * Is this a supported Machine? (ie. is it a Toshiba)
+ * Every SCI call goes through here, to the selected transport, so that
+ * it can be recorded and timed. Gets and sets are retried by smmRetry()
+ * when the BIOS is not ready.
  */
-int 
-SciSupportCheck(int *version)
+static int
+sciCall(int iface, SMMRegisters *reg)
 {
-
- if ( accessMode==ACCESS_DIRECT )
-   return dSciSupportCheck(version);
- else {
-   SMMRegisters regs;
-
-   regs.eax = 0xf0f0;
-   regs.ebx = 0x0000;
-   regs.ecx = 0x0000;
-   regs.edx = 0x0000;
-
-   if ( smmAccess(&regs) != 1 ) {
-     *version = (int) regs.edx;
-     return (int) (regs.eax & 0xff00)>>8;
-   }
+ SmmCall call;
+ int ret,version=0;
+
+ smmCallBegin(&call,iface,reg);
+ switch ( iface ) {
+   case SMM_SCI_SUPPORT:
+     ret = transport->sciSupportCheck(&version);
+     reg->edx = version;
+     break;
+   case SMM_SCI_OPEN  : ret = transport->sciOpenInterface() ; break;
+   case SMM_SCI_CLOSE : ret = transport->sciCloseInterface(); break;
+   case SMM_SCI_GET   : ret = transport->sciGet(reg)        ; break;
+   default            : ret = transport->sciSet(reg)        ; break;
  }
- return SCI_FAILURE;
-} /* SciSupportCheck */
+ return smmCallEnd(&call,reg,ret);
+} /* sciCall */
 
+int
+SciSupportCheck(int *version)
+{
+ SMMRegisters reg = { 0xf0f0 };
+ int ret = sciCall(SMM_SCI_SUPPORT,&reg);
+ *version = (int) reg.edx;
+ return ret;
+} /* SciSupportCheck */
 
-/*
- * Open an interface to the Toshiba hardware.
- *
- *   Note: Set and Get will not work unless an interface has been opened.
- */
-int 
+int
 SciOpenInterface()
 {
- if ( accessMode==ACCESS_DIRECT )
-   return dSciOpenInterface();
- else {
-   SMMRegisters regs;
-   regs.eax = 0xf1f1;
-   regs.ebx = 0x0000;
-   regs.ecx = 0x0000;
-
-   if ( smmAccess(&regs) != 1 ) {
-     return (int) (regs.eax & 0xff00)>>8;
-   }
- }
- return SCI_FAILURE;
+ SMMRegisters reg = { 0xf1f1 };
+ return sciCall(SMM_SCI_OPEN,&reg);
 } /* SciOpenInterface */
 
-
-/*
- * Close any open interface to the hardware
- */
-int 
+int
 SciCloseInterface()
 {
- if ( accessMode==ACCESS_DIRECT )
-   return dSciCloseInterface();
- else {
-   SMMRegisters regs;
-   regs.eax = 0xf2f2;
-   regs.ebx = 0x0000;
-   regs.ecx = 0x0000;
-   
-   if ( smmAccess(&regs) != 1 ) {
-     return (int) (regs.eax & 0xff00)>>8;
-   }
- }
- return SCI_FAILURE;
+ SMMRegisters reg = { 0xf2f2 };
+ return sciCall(SMM_SCI_CLOSE,&reg);
 } /* SciCloseInterface */
 
-
-/*
- * Get the setting of a given mode of the laptop
- */
-
-int 
+int
 SciGet(SMMRegisters *reg)
 {
- if ( accessMode==ACCESS_DIRECT ) 
-   return dSciGet(reg);
- else {
-   reg->eax = 0xf3f3;
-
-   if ( smmAccess(reg) != 1 ) {
-     reg->ebx  &= 0xffff;
-     reg->ecx  &= 0xffff;
-     reg->edx  &= 0xffff;
-     return (int) (reg->eax & 0xff00)>>8;
-   }
- }
- return SCI_FAILURE;
+ SMMRegisters in;
+ int ret;
+
+ /* a get's only input is the register number in ebx; clear the rest so
+    the cache and the trace never key on whatever the caller left there */
+ reg->eax = 0xf3f3;
+ reg->ecx = reg->edx = reg->esi = reg->edi = 0;
+ if ( (ret=smmCacheGet(SMM_SCI_GET,reg))>=0 )
+   return ret;
+ in = *reg;
+ ret = smmRetry(SMM_SCI_GET,reg,sciCall);
+ smmCachePut(SMM_SCI_GET,&in,reg,ret);
+ return ret;
 } /* SciGet */
 
-
-
-/*
- * Set the setting of a given mode of the laptop
- */
-int 
+int
 SciSet(SMMRegisters *reg)
 {
- if ( accessMode==ACCESS_DIRECT )
-   return dSciSet(reg);
- else {
-   reg->eax = 0xf4f4;
-   if ( smmAccess(reg) != 1 ) 
-     return (int) (reg->eax & 0xff00)>>8;
- }
- return SCI_FAILURE;
+ reg->eax = 0xf4f4;
+ smmCacheFlush();
+ return smmRetry(SMM_SCI_SET,reg,sciCall);
 } /* SciSet */
-
-
@@ -176,6 +176,10 @@ enum {
 	SCI_LAN_CONTROLLER  = 0x0130,
 	SCI_SOUND_LOGO      = 0x0138,
 	SCI_STARTUP_LOGO    = 0x013a,
+	SCI_ILLUMINATION    = 0x014e,
+	SCI_KBD_BACKLIGHT   = 0x015c,
+	SCI_FAST_BOOT       = 0x015d,
+	SCI_SLEEP_MUSIC     = 0x015e,
 	SCI_LCD_BACKLIGHT   = 0x0305,
 	SCI_DISPLAY_STRETCH = 0x0308,
 	SCI_PARALLEL_PORT   = 0x0501,
@@ -183,6 +187,7 @@ enum {
 	SCI_INFRARED_PORT   = 0x0508,
 	SCI_USB_LEGACY_MODE = 0x050c,
 	SCI_USB_FDD_EMULAT  = 0x050d,
+	SCI_TRACKPAD        = 0x050e,
 	SCI_PASSWORD_MODE   = 0x0600,
 	SCI_PASSWORD_CHECK  = 0x0601,
 	SCI_PASSWORD        = 0x0602,
@@ -317,6 +322,13 @@ enum {
 	SCI_ANIMATION_LOGO  = 0x0001
 };
 
+enum {
+	SCI_KBD_FNZ         = 0x0001,
+	SCI_KBD_AUTO        = 0x0002,
+	SCI_KBD_ON          = 0x0008,
+	SCI_KBD_OFF         = 0x0010
+};
+
 
 /*
  * SCI error codes
@@ -0,0 +1,209 @@
+/* settingValues.c -- the settings of toshset's list features
+ *
+ * For every feature which takes one of a list of settings, in order: the
+ * option argument which selects it, the register value behind it and the
+ * name -q shows for it. toshset builds its features from this table, and
+ * toshset-fleet names the settings in snapshot images with it, by feature
+ * name and index in the list, so the two always agree.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<string.h>
+
+#include "sci.h"
+#include "hci.h"
+#include "settingValues.h"
+
+const SettingValue settingValues[] = {
+  { "battery save mode", "user"   , SCI_USER_SETTINGS, "user settings" },
+  { "battery save mode", "full"   , SCI_FULL_POWER   , "full power" },
+  { "battery save mode", "low"    , SCI_LOW_POWER    , "low power" },
+  { "battery save mode", "economy", SCI_ECONOMY      , "economy settings" },
+  { "battery save mode", "normal" , SCI_NORMAL_LIFE  , "normal life" },
+  { "battery save mode", "long"   , SCI_LONG_LIFE    , "long life" },
+  { "battery save mode", "full"   , SCI_FULL_LIFE    , "full life" },
+
+  { "power source", "", 3, "battery" },
+  { "power source", "", 4, "external" },
+
+  { "LCD backlight", "off", HCI_DISABLE, "off" },
+  { "LCD backlight", "on" , HCI_ENABLE , "on" },
+
+  { "transreflective mode", "off", HCI_ENABLE , "off" },
+  { "transreflective mode", "on" , HCI_DISABLE, "on" },
+
+  { "fan", "off"  , HCI_DISABLE  , "off" },
+  { "fan", "on"   , HCI_ENABLE   , "on" },
+  { "fan", "fan1" , HCI_FAN_FAN1 , "fan1" },
+  { "fan", "fan2" , HCI_FAN_FAN2 , "fan2" },
+  { "fan", "1/4"  , HCI_FAN_LOW2 , "1/4" },
+  { "fan", "3/4"  , HCI_FAN_HIGH2, "3/4" },
+  { "fan", "2/4"  , HCI_FAN_LOW3 , "2/4" },
+  { "fan", "high1", HCI_FAN_HIGH1, "high1" },
+  { "fan", "high" , HCI_FAN_HIGH , "high" },
+  { "fan", "low"  , HCI_FAN_LOW  , "low" },
+  { "fan", "1/8"  , HCI_FAN_LOW4 , "1/8" },
+
+  { "select bay", "", HCI_NOTHING, "empty" },
+  { "select bay", "", HCI_FLOPPY , "floppy" },
+  { "select bay", "", HCI_ATAPI  , "CDROM" },
+  { "select bay", "", HCI_IDE    , "hard disk" },
+  { "select bay", "", HCI_BATTERY, "battery" },
+
+  { "select bay lock", "engage", HCI_LOCKED  , "engaged" },
+  { "select bay lock", "dis"   , HCI_UNLOCKED, "disabled" },
+
+  { "IR port", "off", SCI_OFF, "off" },
+  { "IR port", "on" , SCI_ON , "on" },
+
+  { "USB legacy mode", "disable", SCI_DISABLED, "disabled" },
+  { "USB legacy mode", "enable" , SCI_ENABLED , "enabled" },
+
+  { "USB FDD emulation mode", "disable", SCI_DISABLED, "disabled" },
+  { "USB FDD emulation mode", "enable" , SCI_ENABLED , "enabled" },
+
+  { "LAN controller", "disable", SCI_DISABLED, "disabled" },
+  { "LAN controller", "enable" , SCI_ENABLED , "enabled" },
+
+  { "sound logo", "disable", SCI_DISABLED, "disabled" },
+  { "sound logo", "enable" , SCI_ENABLED , "enabled" },
+
+  { "startup logo", "picture"  , SCI_PICTURE_LOGO  , "picture" },
+  { "startup logo", "animation", SCI_ANIMATION_LOGO, "animation" },
+
+  { "illumination", "off", SCI_OFF, "off" },
+  { "illumination", "on" , SCI_ON , "on" },
+
+  { "trackpad", "disable", SCI_DISABLED, "disabled" },
+  { "trackpad", "enable" , SCI_ENABLED , "enabled" },
+
+  { "fast boot", "off", SCI_OFF, "off" },
+  { "fast boot", "on" , SCI_ON , "on" },
+
+  { "sleep and music", "off", SCI_OFF, "off" },
+  { "sleep and music", "on" , SCI_ON , "on" },
+
+  { "keyboard backlight", "off" , SCI_KBD_OFF , "off" },
+  { "keyboard backlight", "on"  , SCI_KBD_ON  , "on" },
+  { "keyboard backlight", "auto", SCI_KBD_AUTO, "auto (on with a key press)" },
+
+  { "Video out", "int"  , HCI_INTERNAL    , "internal: LCD" },
+  { "Video out", "ext"  , HCI_EXTERNAL    , "external monitor" },
+  { "Video out", "both" , HCI_SIMULTANEOUS, "internal and external monitor" },
+  { "Video out", "tv"   , HCI_TVOUT       , "tv out" },
+  { "Video out", "mode5", 0x105           , "mode5 ??" },
+  { "Video out", "mode6", 0x106           , "mode6 ??" },
+  { "Video out", "mode7", 0x107           , "mode7 ??" },
+
+  { "system beep", "off", SCI_OFF, "off" },
+  { "system beep", "on" , SCI_ON , "on" },
+
+  { "lcd brightness", "semi"  , SCI_SEMI_BRIGHT , "semi-bright" },
+  { "lcd brightness", "bright", SCI_BRIGHT      , "bright" },
+  { "lcd brightness", "super" , SCI_SUPER_BRIGHT, "super-bright" },
+
+  { "CPU speed", "slow", SCI_LOW , "slow" },
+  { "CPU speed", "fast", SCI_HIGH, "fast" },
+
+  { "CPU sleep mode", "off", SCI_OFF, "off" },
+  { "CPU sleep mode", "on" , SCI_ON , "on" },
+
+  { "Display stretch", "off", SCI_OFF, "off" },
+  { "Display stretch", "on" , SCI_ON , "on" },
+
+  { "CPU cache", "off", SCI_OFF, "off" },
+  { "CPU cache", "on" , SCI_ON , "on" },
+
+  { "cache policy", "write-back"   , 0, "write back" },
+  { "cache policy", "write-through", 1, "write through" },
+
+  { "speaker volume", "off"   , SCI_VOLUME_OFF   , "off" },
+  { "speaker volume", "low"   , SCI_VOLUME_LOW   , "low" },
+  { "speaker volume", "medium", SCI_VOLUME_MEDIUM, "medium" },
+  { "speaker volume", "high"  , SCI_VOLUME_HIGH  , "high" },
+
+  { "battery alarm", "off", SCI_OFF, "off" },
+  { "battery alarm", "on" , SCI_ON , "on" },
+
+  { "panel alarm", "off", SCI_OFF, "off" },
+  { "panel alarm", "on" , SCI_ON , "on" },
+
+  { "panel power", "off", SCI_OFF, "off" },
+  { "panel power", "on" , SCI_ON , "on" },
+
+  { "hard disk auto-off time", "dis", SCI_TIME_DISABLED, "disabled" },
+  { "hard disk auto-off time", "1"  , SCI_TIME_01      , "1 minute" },
+  { "hard disk auto-off time", "3"  , SCI_TIME_03      , "3 minutes" },
+  { "hard disk auto-off time", "5"  , SCI_TIME_05      , "5 minutes" },
+  { "hard disk auto-off time", "10" , SCI_TIME_10      , "10 minutes" },
+  { "hard disk auto-off time", "15" , SCI_TIME_15      , "15 minutes" },
+  { "hard disk auto-off time", "20" , SCI_TIME_20      , "20 minutes" },
+  { "hard disk auto-off time", "30" , SCI_TIME_30      , "30 minutes" },
+
+  { "display auto-off time", "dis", SCI_TIME_DISABLED, "disabled" },
+  { "display auto-off time", "1"  , SCI_TIME_01      , "1 minute" },
+  { "display auto-off time", "3"  , SCI_TIME_03      , "3 minutes" },
+  { "display auto-off time", "5"  , SCI_TIME_05      , "5 minutes" },
+  { "display auto-off time", "10" , SCI_TIME_10      , "10 minutes" },
+  { "display auto-off time", "15" , SCI_TIME_15      , "15 minutes" },
+  { "display auto-off time", "20" , SCI_TIME_20      , "20 minutes" },
+  { "display auto-off time", "30" , SCI_TIME_30      , "30 minutes" },
+
+  { "power-up mode", "boot"     , SCI_BOOT           , "boot" },
+  { "power-up mode", "resume"   , SCI_RESUME         , "resume" },
+  { "power-up mode", "hibernate", SCI_HIBERNATE      , "hibernate" },
+  { "power-up mode", "quick"    , SCI_QUICK_HIBERNATE, "quick-hibernate" },
+
+  { "cooling method", "perform", SCI_PERFORMANCE, "performance" },
+  { "cooling method", "quiet"  , SCI_QUIET      , "quiet" },
+  { "cooling method", "other"  , 2              , "other" },
+
+  { "auto-off time", "dis", SCI_TIME_DISABLED, "disabled" },
+  { "auto-off time", "10" , SCI_TIME_10      , " 10 minutes" },
+  { "auto-off time", "20" , SCI_TIME_20      , " 20 minutes" },
+  { "auto-off time", "30" , SCI_TIME_30      , " 30 minutes" },
+  { "auto-off time", "40" , SCI_TIME_40      , " 40 minutes" },
+  { "auto-off time", "50" , SCI_TIME_50      , " 50 minutes" },
+  { "auto-off time", "60" , SCI_TIME_60      , " 60 minutes" },
+
+  { "parallel port mode", "ecp", SCI_PARALLEL_ECP, "ecp" },
+  { "parallel port mode", "spp", SCI_PARALLEL_SPP, "spp" },
+  { "parallel port mode", "ps2", SCI_PARALLEL_PS2, "ps2" },
+
+  { "Hibernation", "disable", 0, "not configured" },
+  { "Hibernation", "enable" , 1, "configured" },
+
+  { "Pointer", "0", 0, "0" },
+  { "Pointer", "1", 1, "1" },
+  { "Pointer", "2", 2, "2" },
+  { "Pointer", "3", 3, "3" },
+
+  { "boot method", "fdhdcd", SCI_FD_HD, "floppy->hard disk->CDROM" },
+  { "boot method", "hdfdcd", SCI_HD_FD, "hard disk->floppy->CDROM" },
+  { "boot method", "fdcdhd", 2        , "floppy->CDROM->hard disk" },
+  { "boot method", "hdcdfd", 3        , "hard disk->CDROM->floppy" },
+  { "boot method", "cdfdhd", 4        , "CDROM->floppy->hard disk" },
+  { "boot method", "cdhdfd", 5        , "CDROM->hard disk->floppy" },
+
+  { "wireless support", "", 0  , "not present" },
+  { "wireless support", "", 0xf, "present" },
+  { 0 }
+};
+
+const char*
+settingValueName(const char* feature, int code, unsigned int* reg)
+{
+ const SettingValue* v;
+
+ for (v=settingValues ; v->feature ; v++)
+   if ( strcmp(v->feature,feature)==0 && code-- == 0 ) {
+     if ( reg )
+       *reg = v->code;
+     return v->output;
+   }
+ return 0;
+} /* settingValueName */
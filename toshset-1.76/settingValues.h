@@ -0,0 +1,32 @@
+#ifndef __settingValues_h__
+#define __settingValues_h__
+
+/*
+  the list of settings of each list feature, shared by toshset and
+toshset-fleet. See settingValues.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  const char*    feature;   /* Feature::name */
+  const char*    input;     /* option argument which selects it */
+  unsigned short code;      /* register value */
+  const char*    output;    /* as -q shows it */
+} SettingValue;
+
+/* grouped by feature, settings in list order; ends with feature 0 */
+extern const SettingValue settingValues[];
+
+// the name of setting number code of feature, and in reg (unless 0) its
+// register value; 0 if there is no such setting
+const char* settingValueName(const char* feature, int code,
+			     unsigned int* reg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __settingValues_h__ */
@@ -0,0 +1,94 @@
+/* smmCache.c -- cache of BIOS reads for -batch
+ *
+ * A batch of commands tends to read the same registers over and over:
+ * every query, every -txn comparison and every check after a set. While
+ * smmCacheEnabled is set, successful SciGet calls and HCI_GET calls are
+ * remembered by their full input registers, and a repeat is answered
+ * from here without reaching the BIOS. Any other call may change a
+ * setting, or one which depends on it (battery save mode locks several),
+ * so it empties the cache.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<string.h>
+
+#include "smmCache.h"
+
+#define CACHE_SLOTS 128           /* power of two */
+
+typedef struct {
+  int          used;
+  int          iface;
+  SMMRegisters in;
+  SMMRegisters out;
+  int          ret;
+} CacheEntry;
+
+int smmCacheEnabled=0;
+
+static CacheEntry table[CACHE_SLOTS];
+
+static unsigned int
+hash(int iface, const SMMRegisters* in)
+{
+ return (iface*31 + in->eax*17 + in->ebx*7 + in->ecx*5 + in->edx*3 +
+	 in->esi) & (CACHE_SLOTS-1);
+} /* hash */
+
+static int
+same(const CacheEntry* e, int iface, const SMMRegisters* in)
+{
+ return e->iface==iface && e->in.eax==in->eax && e->in.ebx==in->ebx &&
+	e->in.ecx==in->ecx && e->in.edx==in->edx &&
+	e->in.esi==in->esi && e->in.edi==in->edi;
+} /* same */
+
+int
+smmCacheGet(int iface, SMMRegisters* reg)
+{
+ unsigned int h;
+ int i;
+
+ if ( !smmCacheEnabled )
+   return -1;
+ for (i=0, h=hash(iface,reg) ; i<CACHE_SLOTS ; i++, h=(h+1)&(CACHE_SLOTS-1)) {
+   if ( !table[h].used )
+     return -1;
+   if ( same(&table[h],iface,reg) ) {
+     *reg = table[h].out;
+     return table[h].ret;
+   }
+ }
+ return -1;
+} /* smmCacheGet */
+
+void
+smmCachePut(int iface, const SMMRegisters* in, const SMMRegisters* out,
+	    int ret)
+{
+ unsigned int h;
+ int i;
+
+ if ( !smmCacheEnabled || ret!=0 )
+   return;
+ for (i=0, h=hash(iface,in) ; i<CACHE_SLOTS ; i++, h=(h+1)&(CACHE_SLOTS-1))
+   if ( !table[h].used || same(&table[h],iface,in) ) {
+     table[h].used  = 1;
+     table[h].iface = iface;
+     table[h].in    = *in;
+     table[h].out   = *out;
+     table[h].ret   = ret;
+     return;
+   }
+} /* smmCachePut */
+
+void
+smmCacheFlush()
+{
+ if ( smmCacheEnabled )
+   memset(table,0,sizeof(table));
+} /* smmCacheFlush */
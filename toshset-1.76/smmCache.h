@@ -0,0 +1,33 @@
+
+#ifndef __smmCache_h__
+#define __smmCache_h__
+
+/*
+  answers to BIOS reads, kept so that -batch commands asking the same
+thing again cost nothing; any write drops them all. See smmCache.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+extern int smmCacheEnabled;
+
+// the return code of a cached read of the registers in reg, whose
+// outputs are then filled in; -1 if there is none
+int  smmCacheGet(int iface, SMMRegisters* reg);
+void smmCachePut(int iface, const SMMRegisters* in, const SMMRegisters* out,
+		 int ret);
+void smmCacheFlush();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __smmCache_h__ */
@@ -0,0 +1,162 @@
+/* smmRetry.c -- retry policy for busy SCI/HCI calls
+ *
+ * The BIOS answers HCI_BUSY or HCI_NOTREADY (SCI_NOT_READY for SCI) when
+ * the embedded controller is occupied; the call was not carried out and
+ * may simply be repeated. smmRetry() does so for every SciGet, SciSet
+ * and HciFunction, so that the features need no retry logic of their own.
+ *
+ * Retries back off exponentially with jitter, from RETRY_MIN_US up to
+ * RETRY_MAX_US between attempts, until the register's deadline has passed.
+ * For every (interface, eax, ebx) the fraction of busy answers is tracked
+ * as a moving average; registers that are usually busy start with a
+ * longer first wait, so a loaded machine is not polled back-to-back.
+ *
+ * TOSHSET_RETRY_DEADLINE=ms overrides every deadline; 0 turns retries off.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdlib.h>
+#include<unistd.h>
+#include<time.h>
+
+#include "sci.h"
+#include "hci.h"
+#include "transport.h"
+#include "smmTrace.h"
+#include "smmStats.h"
+#include "smmRetry.h"
+
+#define RETRY_MIN_US     100
+#define RETRY_MAX_US     20000
+#define RETRY_DEADLINE   250          /* ms, unless listed below */
+#define RETRY_SLOTS      64           /* power of two */
+#define RETRY_RATE_SHIFT 3            /* moving average over ~8 calls */
+#define RETRY_RATE_ONE   (1<<16)      /* busyRate fixed point 1.0 */
+
+/* registers that legitimately stay busy for longer */
+static const struct {
+  int            iface;
+  unsigned short ebx;
+  int            ms;
+} deadlines[] = {
+  { SMM_HCI    , HCI_WIRELESS   , 2000 },  /* radio power up/down */
+  { SMM_HCI    , HCI_OWNERSTRING, 1000 },
+  { SMM_SCI_SET, SCI_PASSWORD   , 1000 },
+};
+
+typedef struct {
+  int            used;
+  int            iface;
+  unsigned int   eax,ebx;
+  int            busyRate;
+} RetryEntry;
+
+static RetryEntry   table[RETRY_SLOTS];
+static int          deadlineOverride=-2;   /* -2: not looked up yet */
+static unsigned int seed;
+
+static RetryEntry*
+lookup(int iface, unsigned int eax, unsigned int ebx)
+{
+ unsigned int h = (iface*31 + eax*17 + ebx) & (RETRY_SLOTS-1);
+ int i;
+
+ for (i=0 ; i<RETRY_SLOTS ; i++, h=(h+1)&(RETRY_SLOTS-1)) {
+   RetryEntry* e = &table[h];
+   if ( !e->used ) {
+     e->used = 1;
+     e->iface = iface;
+     e->eax = eax;
+     e->ebx = ebx;
+     return e;
+   }
+   if ( e->iface==iface && e->eax==eax && e->ebx==ebx )
+     return e;
+ }
+ return 0;
+} /* lookup */
+
+static int
+isBusy(int iface, int ret)
+{
+ if ( iface==SMM_HCI )
+   return ret==HCI_BUSY || ret==HCI_NOTREADY;
+ return ret==SCI_NOT_READY;
+} /* isBusy */
+
+static int
+deadlineMs(int iface, unsigned int ebx)
+{
+ unsigned int i;
+
+ if ( deadlineOverride==-2 ) {
+   const char* env = getenv("TOSHSET_RETRY_DEADLINE");
+   deadlineOverride = env ? atoi(env) : -1;
+   seed = getpid() ^ time(0);
+ }
+ if ( deadlineOverride>=0 )
+   return deadlineOverride;
+ for (i=0 ; i<sizeof(deadlines)/sizeof(deadlines[0]) ; i++)
+   if ( deadlines[i].iface==iface && deadlines[i].ebx==ebx )
+     return deadlines[i].ms;
+ return RETRY_DEADLINE;
+} /* deadlineMs */
+
+static long long
+elapsedUs(const struct timespec* start)
+{
+ struct timespec now;
+
+ clock_gettime(CLOCK_MONOTONIC,&now);
+ return (now.tv_sec-start->tv_sec)*1000000LL +
+	(now.tv_nsec-start->tv_nsec)/1000;
+} /* elapsedUs */
+
+int
+smmRetry(int iface, SMMRegisters* reg, SmmCallFn call)
+{
+ SMMRegisters in = *reg;
+ RetryEntry* e = lookup(iface,reg->eax & 0xffff,reg->ebx & 0xffff);
+ long long limitUs = deadlineMs(iface,reg->ebx & 0xffff)*1000LL;
+ int noWait = transportHas(TRANSPORT_NO_WAIT);
+ struct timespec start;
+ long long waitedUs=0;
+ long delayUs;
+ int busy,ret;
+
+ clock_gettime(CLOCK_MONOTONIC,&start);
+
+ // first wait grows from RETRY_MIN_US to 16 times that with the busy rate
+ delayUs = RETRY_MIN_US;
+ if ( e )
+   delayUs += (long)(((unsigned long long)e->busyRate*15*RETRY_MIN_US) /
+		     RETRY_RATE_ONE);
+
+ for (;;) {
+   ret = call(iface,reg);
+   busy = isBusy(iface,ret);
+   if ( e )
+     e->busyRate += ((busy ? RETRY_RATE_ONE : 0) - e->busyRate) >>
+		    RETRY_RATE_SHIFT;
+   if ( !busy || (noWait ? waitedUs : elapsedUs(&start))+delayUs > limitUs )
+     return ret;
+
+   // equal jitter: half the delay fixed, half random. A replayed trace
+   // already holds the busy answers, so it is just stepped through on a
+   // clock of the delays that would have been slept.
+   if ( noWait )
+     waitedUs += delayUs;
+   else
+     usleep(delayUs/2 + rand_r(&seed)%(delayUs/2+1));
+   delayUs *= 2;
+   if ( delayUs>RETRY_MAX_US )
+     delayUs = RETRY_MAX_US;
+   *reg = in;
+   if ( smmStatsEnabled )
+     smmStatsRetry(iface,&in);
+ }
+} /* smmRetry */
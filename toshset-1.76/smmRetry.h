@@ -0,0 +1,29 @@
+
+#ifndef __smmRetry_h__
+#define __smmRetry_h__
+
+/*
+  retry policy for BIOS calls answered with busy/not ready. sci.c and
+hci.c route SciGet, SciSet and HciFunction through smmRetry(); see
+smmRetry.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+typedef int (*SmmCallFn)(int iface, SMMRegisters* reg);
+
+int smmRetry(int iface, SMMRegisters* reg, SmmCallFn call);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __smmRetry_h__ */
@@ -0,0 +1,180 @@
+/* smmStats.c -- per-register call counters and latency histograms
+ *
+ * Every BIOS call is accounted under its (interface, eax, ebx) key:
+ * number of calls, failures (non-zero return), retries (calls repeated by
+ * smmRetry() after a busy answer) and a latency histogram.
+ *
+ * The histogram is log-linear in the manner of HdrHistogram: each power
+ * of two is split into STATS_SUB linear sub-buckets, so every recorded
+ * latency is known to within 1/STATS_SUB (12.5%) of its value, from 1 ns
+ * up to about 18 minutes, in a fixed 1280 bytes per key.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdlib.h>
+#include<string.h>
+
+#include "smmStats.h"
+#include "smmTrace.h"
+
+#define STATS_SUB_BITS 3
+#define STATS_SUB      (1<<STATS_SUB_BITS)
+#define STATS_MAX_EXP  39
+#define STATS_BUCKETS  ((STATS_MAX_EXP-STATS_SUB_BITS+2)*STATS_SUB)
+#define STATS_SLOTS    128          /* power of two; distinct keys seen */
+
+typedef struct {
+  int                used;
+  int                iface;
+  unsigned int       eax,ebx;
+  unsigned long      calls,failures,retries;
+  unsigned long long totalNs,maxNs;
+  unsigned int       hist[STATS_BUCKETS];
+} StatsEntry;
+
+int smmStatsEnabled=0;
+
+static StatsEntry table[STATS_SLOTS];
+
+static int
+bucketOf(unsigned long long v)
+{
+ int e;
+
+ if ( v<STATS_SUB )
+   return (int) v;
+ e = 63-__builtin_clzll(v);
+ if ( e>STATS_MAX_EXP )
+   return STATS_BUCKETS-1;
+ return (e-STATS_SUB_BITS+1)*STATS_SUB + (int)((v>>(e-STATS_SUB_BITS)) &
+					       (STATS_SUB-1));
+} /* bucketOf */
+
+/* smallest value that lands in bucket b */
+static unsigned long long
+bucketValue(int b)
+{
+ int e;
+
+ if ( b<STATS_SUB )
+   return b;
+ e = b/STATS_SUB + STATS_SUB_BITS - 1;
+ return (unsigned long long)(STATS_SUB + b%STATS_SUB) << (e-STATS_SUB_BITS);
+} /* bucketValue */
+
+static StatsEntry*
+lookup(int iface, unsigned int eax, unsigned int ebx)
+{
+ unsigned int h = (iface*31 + eax*17 + ebx) & (STATS_SLOTS-1);
+ int i;
+
+ for (i=0 ; i<STATS_SLOTS ; i++, h=(h+1)&(STATS_SLOTS-1)) {
+   StatsEntry* e = &table[h];
+   if ( !e->used ) {
+     e->used = 1;
+     e->iface = iface;
+     e->eax = eax;
+     e->ebx = ebx;
+     return e;
+   }
+   if ( e->iface==iface && e->eax==eax && e->ebx==ebx )
+     return e;
+ }
+ return 0;
+} /* lookup */
+
+void
+smmStatsAccount(int iface, const SMMRegisters* in, int ret,
+		unsigned long long ns)
+{
+ StatsEntry* e = lookup(iface,in->eax & 0xffff,in->ebx & 0xffff);
+
+ if ( !e )
+   return;
+ e->calls++;
+ if ( ret && iface!=SMM_HCI_BIOS )      /* that one returns the version */
+   e->failures++;
+ e->totalNs += ns;
+ if ( ns>e->maxNs )
+   e->maxNs = ns;
+ e->hist[bucketOf(ns)]++;
+} /* smmStatsAccount */
+
+void
+smmStatsRetry(int iface, const SMMRegisters* in)
+{
+ StatsEntry* e = lookup(iface,in->eax & 0xffff,in->ebx & 0xffff);
+
+ if ( e )
+   e->retries++;
+} /* smmStatsRetry */
+
+static unsigned long long
+percentile(const StatsEntry* e, int pct)
+{
+ unsigned long want = (e->calls*pct + 99) / 100;
+ unsigned long seen = 0;
+ int b;
+
+ for (b=0 ; b<STATS_BUCKETS ; b++) {
+   seen += e->hist[b];
+   if ( seen>=want && seen )
+     return bucketValue(b);
+ }
+ return e->maxNs;
+} /* percentile */
+
+static int
+entryCmp(const void* a, const void* b)
+{
+ const StatsEntry* x=a;
+ const StatsEntry* y=b;
+ if ( x->used!=y->used ) return y->used-x->used;
+ if ( x->iface!=y->iface ) return x->iface-y->iface;
+ if ( x->eax!=y->eax )     return x->eax<y->eax ? -1 : 1;
+ if ( x->ebx!=y->ebx )     return x->ebx<y->ebx ? -1 : 1;
+ return 0;
+} /* entryCmp */
+
+void
+smmStatsDump(FILE* fp, int format)
+{
+ StatsEntry* sorted;
+ int i;
+
+ sorted = malloc(sizeof(table));
+ if ( !sorted )
+   return;
+ memcpy(sorted,table,sizeof(table));
+ qsort(sorted,STATS_SLOTS,sizeof(StatsEntry),entryCmp);
+
+ if ( format==STATS_CSV )
+   fprintf(fp,"interface,eax,ebx,calls,failures,retries,total_ns,"
+	   "p50_ns,p90_ns,p99_ns,max_ns\n");
+ else
+   fprintf(fp,"%-12s %-6s %-6s %6s %5s %5s %9s %9s %9s %9s %9s\n",
+	   "interface","eax","ebx","calls","fail","retry",
+	   "mean us","p50 us","p90 us","p99 us","max us");
+
+ for (i=0 ; i<STATS_SLOTS && sorted[i].used ; i++) {
+   const StatsEntry* e = &sorted[i];
+   if ( format==STATS_CSV )
+     fprintf(fp,"%s,0x%04x,0x%04x,%lu,%lu,%lu,%llu,%llu,%llu,%llu,%llu\n",
+	     smmIfaceName(e->iface),e->eax,e->ebx,
+	     e->calls,e->failures,e->retries,e->totalNs,
+	     percentile(e,50),percentile(e,90),percentile(e,99),e->maxNs);
+   else
+     fprintf(fp,"%-12s 0x%04x 0x%04x %6lu %5lu %5lu "
+	     "%9.1f %9.1f %9.1f %9.1f %9.1f\n",
+	     smmIfaceName(e->iface),e->eax,e->ebx,
+	     e->calls,e->failures,e->retries,
+	     e->totalNs/1000.0/e->calls,
+	     percentile(e,50)/1000.0,percentile(e,90)/1000.0,
+	     percentile(e,99)/1000.0,e->maxNs/1000.0);
+ }
+ free(sorted);
+} /* smmStatsDump */
@@ -0,0 +1,35 @@
+
+#ifndef __smmStats_h__
+#define __smmStats_h__
+
+/*
+  per-register call statistics, fed from smmCallEnd(); see smmStats.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+enum { STATS_TEXT, STATS_CSV };
+
+extern int smmStatsEnabled;
+
+void smmStatsAccount(int iface, const SMMRegisters* in, int ret,
+		     unsigned long long ns);
+// a call about to be repeated by smmRetry() after a busy answer
+void smmStatsRetry(int iface, const SMMRegisters* in);
+void smmStatsDump(FILE* fp, int format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __smmStats_h__ */
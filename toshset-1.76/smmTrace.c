@@ -0,0 +1,461 @@
+/* smmTrace.c -- record and replay of SCI/HCI BIOS calls
+ *
+ * With TOSHSET_RECORD=file every call made through sci.c and hci.c is
+ * appended to file: the registers going in, the registers coming out, the
+ * return code and the time the call took. With TOSHSET_REPLAY=file the
+ * calls are answered from such a trace instead of the hardware, so that a
+ * workload captured on a real machine can be rerun anywhere. Set
+ * TOSHSET_REPLAY_TIMING as well to also reproduce the recorded latencies.
+ * "toshset -tracediff a b" compares the call counts and latencies of two
+ * traces.
+ *
+ * The file is an 8 byte header followed by fixed 64 byte records, both in
+ * host byte order:
+ *
+ *   header:  "TSMT"  u32 version
+ *   record:  u64 ns  u8 iface  u8 pad  u16 ret  u32 in[6]  u32 out[6]
+ *            u32 reserved
+ *
+ * Records are only ever appended, so several runs may share one file.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+
+#include "smmTrace.h"
+#include "transport.h"
+#include "smmStats.h"
+#include "chromeTrace.h"
+
+#define TRACE_MAGIC   "TSMT"
+#define TRACE_VERSION 1
+
+typedef struct {
+  char         magic[4];
+  unsigned int version;
+} TraceHeader;
+
+typedef struct {
+  unsigned long long ns;
+  unsigned char      iface;
+  unsigned char      pad;
+  unsigned short     ret;
+  unsigned int       in[6];
+  unsigned int       out[6];
+  unsigned int       reserved;
+} TraceRecord;
+
+typedef struct {
+  TraceRecord* recs;
+  int          num;
+} Trace;
+
+static const char* ifaceNames[SMM_NUM_IFACES] = {
+  "sci-support", "sci-open", "sci-close", "sci-get", "sci-set",
+  "hci", "hci-bios", "hci-id"
+};
+
+const char*
+smmIfaceName(int iface)
+{
+ if ( iface<0 || iface>=SMM_NUM_IFACES )
+   return "unknown";
+ return ifaceNames[iface];
+} /* smmIfaceName */
+
+static void
+regsToWords(unsigned int* w, const SMMRegisters* reg)
+{
+ w[0] = reg->eax;
+ w[1] = reg->ebx;
+ w[2] = reg->ecx;
+ w[3] = reg->edx;
+ w[4] = reg->esi;
+ w[5] = reg->edi;
+} /* regsToWords */
+
+static void
+wordsToRegs(SMMRegisters* reg, const unsigned int* w)
+{
+ reg->eax = w[0];
+ reg->ebx = w[1];
+ reg->ecx = w[2];
+ reg->edx = w[3];
+ reg->esi = w[4];
+ reg->edi = w[5];
+} /* wordsToRegs */
+
+/*
+ * buffered, append-only writer
+ */
+
+static int           recordFd=-1;
+static char          recordBuf[64*1024];
+static unsigned int  recordLen=0;
+
+static void
+recordFlush()
+{
+ unsigned int off=0;
+
+ while ( off<recordLen ) {
+   ssize_t n = write(recordFd,recordBuf+off,recordLen-off);
+   if ( n<=0 )
+     break;
+   off += n;
+ }
+ recordLen = 0;
+} /* recordFlush */
+
+static void
+recordClose()
+{
+ if ( recordFd<0 )
+   return;
+ recordFlush();
+ close(recordFd);
+ recordFd = -1;
+} /* recordClose */
+
+int
+smmRecordOpen(const char* file)
+{
+ struct stat st;
+
+ recordFd = open(file,O_WRONLY|O_CREAT|O_APPEND,0644);
+ if ( recordFd<0 ) {
+   perror(file);
+   return 1;
+ }
+ if ( fstat(recordFd,&st)==0 && st.st_size==0 ) {
+   TraceHeader h;
+   memcpy(h.magic,TRACE_MAGIC,4);
+   h.version = TRACE_VERSION;
+   memcpy(recordBuf,&h,sizeof(h));
+   recordLen = sizeof(h);
+ }
+ atexit(recordClose);
+ return 0;
+} /* smmRecordOpen */
+
+static void
+recordAppend(const TraceRecord* rec)
+{
+ if ( recordLen+sizeof(*rec) > sizeof(recordBuf) )
+   recordFlush();
+ memcpy(recordBuf+recordLen,rec,sizeof(*rec));
+ recordLen += sizeof(*rec);
+} /* recordAppend */
+
+/*
+ * call bracketing
+ */
+
+void
+smmCallBegin(SmmCall* call, int iface, const SMMRegisters* reg)
+{
+ call->iface = iface;
+ call->in = *reg;
+ clock_gettime(CLOCK_MONOTONIC,&call->start);
+} /* smmCallBegin */
+
+int
+smmCallEnd(SmmCall* call, const SMMRegisters* reg, int ret)
+{
+ struct timespec end;
+ unsigned long long ns;
+ TraceRecord rec;
+
+ if ( recordFd<0 && !smmStatsEnabled && !ctraceEnabled )
+   return ret;
+
+ clock_gettime(CLOCK_MONOTONIC,&end);
+ ns = (end.tv_sec-call->start.tv_sec)*1000000000LL +
+      (end.tv_nsec-call->start.tv_nsec);
+ if ( smmStatsEnabled )
+   smmStatsAccount(call->iface,&call->in,ret,ns);
+ if ( ctraceEnabled )
+   ctraceSmm(call->iface,&call->in,ret,&call->start,&end);
+ if ( recordFd<0 )
+   return ret;
+
+ memset(&rec,0,sizeof(rec));
+ rec.ns = ns;
+ rec.iface = call->iface;
+ rec.ret = ret;
+ regsToWords(rec.in,&call->in);
+ regsToWords(rec.out,reg);
+ recordAppend(&rec);
+
+ return ret;
+} /* smmCallEnd */
+
+/*
+ * trace loading
+ */
+
+static int
+traceLoad(Trace* t, const char* file)
+{
+ TraceHeader h;
+ struct stat st;
+ int fd;
+
+ t->recs = 0;
+ t->num = 0;
+ if ( (fd=open(file,O_RDONLY))<0 ) {
+   perror(file);
+   return 1;
+ }
+ if ( fstat(fd,&st) ||
+      read(fd,&h,sizeof(h))!=sizeof(h) ||
+      memcmp(h.magic,TRACE_MAGIC,4) || h.version!=TRACE_VERSION ) {
+   fprintf(stderr,"%s: not a toshset trace\n",file);
+   close(fd);
+   return 1;
+ }
+ t->num = (st.st_size-sizeof(h)) / sizeof(TraceRecord);
+ t->recs = malloc(t->num*sizeof(TraceRecord) + 1);
+ if ( !t->recs ||
+      read(fd,t->recs,t->num*sizeof(TraceRecord)) !=
+      (ssize_t)(t->num*sizeof(TraceRecord)) ) {
+   fprintf(stderr,"%s: short read\n",file);
+   close(fd);
+   return 1;
+ }
+ close(fd);
+ return 0;
+} /* traceLoad */
+
+/*
+ * replay backend
+ */
+
+static Trace          replay;
+static unsigned char* replayUsed=0;
+static int            replayTiming=0;
+
+int
+smmReplayOpen(const char* file)
+{
+ if ( traceLoad(&replay,file) )
+   return 1;
+ replayUsed = calloc(replay.num+1,1);
+ if ( !replayUsed )
+   return 1;
+ replayTiming = getenv("TOSHSET_REPLAY_TIMING")!=0;
+ return 0;
+} /* smmReplayOpen */
+
+static int
+sameKey(const TraceRecord* rec, int iface, const unsigned int* in)
+{
+ return rec->iface==iface &&
+	(rec->in[0] & 0xffff)==(in[0] & 0xffff) &&
+	(rec->in[1] & 0xffff)==(in[1] & 0xffff);
+} /* sameKey */
+
+/*
+ * Answer a call from the trace. The first unused record with identical
+ * input registers wins; failing that, the first unused record for the
+ * same (interface,eax,ebx); failing that, the last record for it is
+ * reused. Calls the trace never saw are answered with NOT_SUPPORTED.
+ * SCI gets take only ebx, and older toshset left stack garbage in the
+ * other registers, so they are matched on (eax,ebx) alone, in order.
+ */
+int
+smmReplay(int iface, SMMRegisters* reg)
+{
+ unsigned int in[6];
+ int i,match=-1,last=-1;
+
+ regsToWords(in,reg);
+ for (i=0 ; i<replay.num && match<0 && iface!=SMM_SCI_GET ; i++)
+   if ( !replayUsed[i] && replay.recs[i].iface==iface &&
+	memcmp(replay.recs[i].in,in,sizeof(in))==0 )
+     match = i;
+ for (i=0 ; i<replay.num && match<0 ; i++)
+   if ( sameKey(&replay.recs[i],iface,in) ) {
+     if ( !replayUsed[i] )
+       match = i;
+     last = i;
+   }
+ if ( match<0 )
+   match = last;
+ if ( match<0 ) {
+   reg->eax = 0x80<<8;
+   return 0x80;
+ }
+
+ replayUsed[match] = 1;
+ wordsToRegs(reg,replay.recs[match].out);
+ if ( replayTiming && replay.recs[match].ns ) {
+   struct timespec ts;
+   ts.tv_sec  = replay.recs[match].ns / 1000000000;
+   ts.tv_nsec = replay.recs[match].ns % 1000000000;
+   nanosleep(&ts,0);
+ }
+ return replay.recs[match].ret;
+} /* smmReplay */
+
+static int
+rHciFunction(SMMRegisters *reg)
+{
+ return smmReplay(SMM_HCI,reg);
+} /* rHciFunction */
+
+static int
+rHciGetBiosVersion()
+{
+ SMMRegisters reg = { 0 };
+ return smmReplay(SMM_HCI_BIOS,&reg);
+} /* rHciGetBiosVersion */
+
+static int
+rHciGetMachineID(int *id)
+{
+ SMMRegisters reg = { 0 };
+ int ret = smmReplay(SMM_HCI_ID,&reg);
+ *id = reg.ecx;
+ return ret;
+} /* rHciGetMachineID */
+
+static int
+rSciSupportCheck(int *version)
+{
+ SMMRegisters reg = { 0xf0f0 };
+ int ret = smmReplay(SMM_SCI_SUPPORT,&reg);
+ *version = reg.edx;
+ return ret;
+} /* rSciSupportCheck */
+
+static int
+rSciOpenInterface()
+{
+ SMMRegisters reg = { 0xf1f1 };
+ return smmReplay(SMM_SCI_OPEN,&reg);
+} /* rSciOpenInterface */
+
+static int
+rSciCloseInterface()
+{
+ SMMRegisters reg = { 0xf2f2 };
+ return smmReplay(SMM_SCI_CLOSE,&reg);
+} /* rSciCloseInterface */
+
+static int
+rSciGet(SMMRegisters *reg)
+{
+ return smmReplay(SMM_SCI_GET,reg);
+} /* rSciGet */
+
+static int
+rSciSet(SMMRegisters *reg)
+{
+ return smmReplay(SMM_SCI_SET,reg);
+} /* rSciSet */
+
+const Transport replayTransport = {
+  "replay", TRANSPORT_NO_WAIT,
+  rHciFunction, rHciGetBiosVersion, rHciGetMachineID,
+  rSciSupportCheck, rSciOpenInterface, rSciCloseInterface,
+  rSciGet, rSciSet, 0
+};
+
+/*
+ * trace comparison
+ */
+
+typedef struct {
+  int                iface;
+  unsigned int       eax,ebx;
+  long               calls[2];
+  unsigned long long ns[2];
+} DiffRow;
+
+static int
+diffRowCmp(const void* a, const void* b)
+{
+ const DiffRow* x=a;
+ const DiffRow* y=b;
+ if ( x->iface!=y->iface ) return x->iface-y->iface;
+ if ( x->eax!=y->eax )     return x->eax<y->eax ? -1 : 1;
+ if ( x->ebx!=y->ebx )     return x->ebx<y->ebx ? -1 : 1;
+ return 0;
+} /* diffRowCmp */
+
+static double
+meanUs(unsigned long long ns, long calls)
+{
+ return calls ? ns/1000.0/calls : 0;
+} /* meanUs */
+
+int
+smmTraceDiff(const char* fileA, const char* fileB)
+{
+ Trace t[2];
+ DiffRow* rows;
+ DiffRow total;
+ int numRows=0;
+ int i,j,k;
+
+ if ( traceLoad(&t[0],fileA) || traceLoad(&t[1],fileB) )
+   return 1;
+
+ rows = calloc(t[0].num+t[1].num+1,sizeof(DiffRow));
+ if ( !rows )
+   return 1;
+ memset(&total,0,sizeof(total));
+
+ for (k=0 ; k<2 ; k++)
+   for (i=0 ; i<t[k].num ; i++) {
+     const TraceRecord* rec = &t[k].recs[i];
+     for (j=0 ; j<numRows ; j++)
+       if ( rows[j].iface==rec->iface &&
+	    rows[j].eax==(rec->in[0] & 0xffff) &&
+	    rows[j].ebx==(rec->in[1] & 0xffff) )
+	 break;
+     if ( j==numRows ) {
+       rows[j].iface = rec->iface;
+       rows[j].eax = rec->in[0] & 0xffff;
+       rows[j].ebx = rec->in[1] & 0xffff;
+       numRows++;
+     }
+     rows[j].calls[k]++;
+     rows[j].ns[k] += rec->ns;
+     total.calls[k]++;
+     total.ns[k] += rec->ns;
+   }
+ qsort(rows,numRows,sizeof(DiffRow),diffRowCmp);
+
+ printf("%-12s %-6s %-6s %8s %8s %10s %10s %10s\n",
+	"interface","eax","ebx","calls A","calls B",
+	"mean us A","mean us B","delta us");
+ for (j=0 ; j<numRows ; j++)
+   printf("%-12s 0x%04x 0x%04x %8ld %8ld %10.1f %10.1f %+10.1f\n",
+	  smmIfaceName(rows[j].iface),rows[j].eax,rows[j].ebx,
+	  rows[j].calls[0],rows[j].calls[1],
+	  meanUs(rows[j].ns[0],rows[j].calls[0]),
+	  meanUs(rows[j].ns[1],rows[j].calls[1]),
+	  ((double)rows[j].ns[1]-(double)rows[j].ns[0])/1000.0);
+ printf("%-26s %8ld %8ld %10.1f %10.1f %+10.1f\n","total",
+	total.calls[0],total.calls[1],
+	meanUs(total.ns[0],total.calls[0]),
+	meanUs(total.ns[1],total.calls[1]),
+	((double)total.ns[1]-(double)total.ns[0])/1000.0);
+
+ free(rows);
+ free(t[0].recs);
+ free(t[1].recs);
+ return 0;
+} /* smmTraceDiff */
@@ -0,0 +1,55 @@
+
+#ifndef __smmTrace_h__
+#define __smmTrace_h__
+
+/*
+  record/replay of BIOS calls. Every call through sci.c/hci.c is bracketed
+by smmCallBegin()/smmCallEnd(); see smmTrace.c for the file format.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+enum {
+  SMM_SCI_SUPPORT,
+  SMM_SCI_OPEN,
+  SMM_SCI_CLOSE,
+  SMM_SCI_GET,
+  SMM_SCI_SET,
+  SMM_HCI,
+  SMM_HCI_BIOS,
+  SMM_HCI_ID,
+  SMM_NUM_IFACES
+};
+
+typedef struct {
+  int             iface;
+  SMMRegisters    in;
+  struct timespec start;
+} SmmCall;
+
+int  smmRecordOpen(const char* file);
+int  smmReplayOpen(const char* file);
+
+void smmCallBegin(SmmCall* call, int iface, const SMMRegisters* reg);
+int  smmCallEnd(SmmCall* call, const SMMRegisters* reg, int ret);
+
+int  smmReplay(int iface, SMMRegisters* reg);
+
+const char* smmIfaceName(int iface);
+int  smmTraceDiff(const char* fileA, const char* fileB);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __smmTrace_h__ */
@@ -0,0 +1,68 @@
+
+#ifndef __snapshot_h__
+#define __snapshot_h__
+
+/*
+  settings images for -snapshot and -restore: a fixed header naming the
+machine and BIOS, then one fixed-size entry per setting. See snapshot.c
+for the layout.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include<stddef.h>
+
+#define SNAPSHOT_NAME_LEN 36
+
+typedef struct {
+  char           magic[4];          /* "TSSN" */
+  unsigned short version;
+  unsigned short entrySize;
+  unsigned int   machineId;
+  unsigned int   biosVersion;
+  unsigned int   count;
+  unsigned int   checksum;          /* CRC-32 of the entries */
+  unsigned int   reserved[2];
+} SnapshotHeader;
+
+typedef struct {
+  unsigned char  iface;             /* RECORD_SCI or RECORD_HCI */
+  unsigned char  pad;
+  unsigned short ebx;
+  short          code;              /* index of the setting in the
+				       feature's list */
+  unsigned short reserved;
+  unsigned int   ecx;               /* the register as read */
+  char           name[SNAPSHOT_NAME_LEN];  /* feature, NUL terminated */
+} SnapshotEntry;
+
+typedef struct {
+  const SnapshotHeader* header;
+  const SnapshotEntry*  entries;
+  void*                 map;
+  size_t                size;
+} Snapshot;
+
+extern int snapshotQuiet;
+// where error messages go: stderr, unless the program points it elsewhere
+extern void (*snapshotMessage)(const char* text);
+
+// write n entries to file, replacing it; 0 on success
+int  snapshotWrite(const char* file, int machineId, int biosVersion,
+		   const SnapshotEntry* entries, int n);
+
+// map file and check that it is a complete image of this version,
+// without reading the entries; 0 on success. Errors are printed unless
+// snapshotQuiet is set.
+int  snapshotOpen(Snapshot* s, const char* file);
+// 0 if the entries match the header's checksum
+int  snapshotVerify(const Snapshot* s);
+void snapshotClose(Snapshot* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __snapshot_h__ */
@@ -0,0 +1,346 @@
+/* sysfs.c -- settings through the Toshiba sysfs attributes
+ *
+ * Newer Toshibas have no /dev/toshiba; the toshiba-tos1900 driver, or
+ * the mainline toshiba_acpi driver, offers a handful of their settings as
+ * attributes of its device instead, one decimal number per file. This
+ * backend answers SCI get and set calls for the registers behind those
+ * attributes, so the features built on them work unchanged; everything
+ * else is NOT_SUPPORTED.
+ *
+ * Each attribute is opened on first use and the descriptor kept for the
+ * rest of the run. Reads are pread() at offset 0, which has sysfs call
+ * the driver's show routine afresh every time, and writes are pwrite().
+ * Without write access an attribute is opened read-only and sets fail
+ * with WRITE_PROTECTED.
+ *
+ * A query of several settings is announced with sSciPrefetch(), which
+ * reads all their attributes in one batch (see batchRead.c) and keeps
+ * each answer for the SciGet that follows. A prefetch always reads
+ * afresh, and any write drops every kept answer: with -batch the SciGet
+ * may be answered from smmCache instead, leaving the answer unused.
+ *
+ * TOSHSET_SYSFS names a directory to use in place of /sys, for testing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<limits.h>
+#include<unistd.h>
+#include<fcntl.h>
+
+#include "sysfs.h"
+#include "transport.h"
+#include "batchRead.h"
+#include "hci.h"
+#include "sci.h"
+
+#define NUM(a) (int)(sizeof(a)/sizeof((a)[0]))
+
+#define SYSFS_DIR        "/sys"
+#define TOS1900_DIR      "/devices/platform/toshiba-tos1900"
+#define ACPI_DIR         "/bus/acpi/devices"
+#define DMI_BIOS         "/class/dmi/id/bios_version"
+#define SYSFS_MACHINE_ID 0xfcf0
+#define SYSFS_UNOPENED   (-2)
+#define SYSFS_MISSING    (-1)
+#define SYSFS_NOCACHE    INT_MIN
+#define SYSFS_BUF        32
+#define SYSFS_MAX_ATTRS  8
+
+/*
+ * SCI register to attribute. An attribute with codes holds the index of
+ * the register value in codes; otherwise it holds the value itself.
+ */
+typedef struct {
+  unsigned short        ebx;
+  const char*           name;
+  const unsigned short* codes;
+  int                   numCodes;
+} SysfsAttr;
+
+/* tos1900 shows 0,1,2 for these keyboard backlight modes */
+static const unsigned short kbdCodes[] = {
+  SCI_KBD_OFF, SCI_KBD_ON, SCI_KBD_AUTO
+};
+
+static const SysfsAttr tos1900Attrs[] = {
+  { SCI_COOLING_METHOD, "cpu_mode"     , 0       , 0 },
+  { SCI_ILLUMINATION  , "illumination" , 0       , 0 },
+  { SCI_KBD_BACKLIGHT , "kbd_backlight", kbdCodes, NUM(kbdCodes) },
+  { SCI_FAST_BOOT     , "fast_boot"    , 0       , 0 },
+  { SCI_SLEEP_MUSIC   , "sleep_and_music", 0     , 0 },
+  { SCI_TRACKPAD      , "trackpad"     , 0       , 0 },
+};
+
+static const SysfsAttr acpiAttrs[] = {
+  { SCI_COOLING_METHOD, "cooling_method"    , 0, 0 },
+  { SCI_KBD_BACKLIGHT , "kbd_backlight_mode", 0, 0 },
+  { SCI_SLEEP_MUSIC   , "usb_sleep_music"   , 0, 0 },
+  { SCI_TRACKPAD      , "touchpad"          , 0, 0 },
+};
+
+/* the ACPI devices toshiba_acpi binds to */
+static const char* acpiIds[] = { "TOS6200", "TOS6207", "TOS6208", "TOS1900" };
+
+typedef struct {
+  int  fd;
+  int  writable;
+  int  cached;           /* prefetched byte count or -errno */
+  char buf[SYSFS_BUF];
+} SysfsFile;
+
+static char             root[1024];
+static char             dmiBios[1024];
+static const SysfsAttr* attrs;
+static int              numAttrs;
+static SysfsFile        files[SYSFS_MAX_ATTRS];
+
+/*
+ * the toshiba_acpi device in sys, if there is one with the driver bound
+ */
+static int
+acpiFind(const char* sys)
+{
+ char version[1100];
+ int i;
+
+ for (i=0 ; i<NUM(acpiIds) ; i++) {
+   snprintf(root,sizeof(root),"%s" ACPI_DIR "/%s:00",sys,acpiIds[i]);
+   snprintf(version,sizeof(version),"%s/version",root);
+   if ( access(version,R_OK)==0 )
+     return 1;
+ }
+ return 0;
+} /* acpiFind */
+
+int
+sysfsInit()
+{
+ const char* sys;
+ int i;
+
+ if ( !(sys=getenv("TOSHSET_SYSFS")) )
+   sys = SYSFS_DIR;
+ snprintf(root,sizeof(root),"%s" TOS1900_DIR,sys);
+ if ( access(root,R_OK|X_OK)==0 ) {
+   attrs = tos1900Attrs;
+   numAttrs = NUM(tos1900Attrs);
+ } else if ( acpiFind(sys) ) {
+   attrs = acpiAttrs;
+   numAttrs = NUM(acpiAttrs);
+ } else
+   return 1;
+ snprintf(dmiBios,sizeof(dmiBios),"%s" DMI_BIOS,sys);
+
+ for (i=0 ; i<numAttrs ; i++) {
+   files[i].fd = SYSFS_UNOPENED;
+   files[i].cached = SYSFS_NOCACHE;
+ }
+ return 0;
+} /* sysfsInit */
+
+static int
+sysfsReturn(SMMRegisters *reg, int code)
+{
+ reg->eax = code<<8;
+ return code;
+} /* sysfsReturn */
+
+static int
+errnoCode(int err)
+{
+ switch ( err ) {
+   case EINVAL: case ERANGE: return SCI_INPUT_ERROR;
+   case ENOENT: case ENODEV: case ENXIO: return SCI_NOT_SUPPORTED;
+   case EACCES: case EPERM: return SCI_WRITE_PROTECTED;
+ }
+ return SCI_DEVICE_ERROR;
+} /* errnoCode */
+
+/*
+ * the attribute for register ebx, opened if need be; -1 if there is none
+ */
+static int
+attrFind(unsigned short ebx)
+{
+ SysfsFile* f;
+ char path[1100];
+ int i;
+
+ for (i=0 ; i<numAttrs ; i++)
+   if ( attrs[i].ebx==ebx )
+     break;
+ if ( i==numAttrs )
+   return -1;
+
+ f = &files[i];
+ if ( f->fd==SYSFS_UNOPENED ) {
+   snprintf(path,sizeof(path),"%s/%s",root,attrs[i].name);
+   f->writable = 1;
+   if ( (f->fd=open(path,O_RDWR))<0 && errno==EACCES ) {
+     f->writable = 0;
+     f->fd = open(path,O_RDONLY);
+   }
+   if ( f->fd<0 )
+     f->fd = SYSFS_MISSING;
+ }
+ return f->fd==SYSFS_MISSING ? -1 : i;
+} /* attrFind */
+
+static int
+sHciFunction(SMMRegisters *reg)
+{
+ return sysfsReturn(reg,HCI_NOT_SUPPORTED);
+} /* sHciFunction */
+
+/*
+ * the driver has nothing to say about the BIOS, but DMI does
+ */
+static int
+sHciGetBiosVersion()
+{
+ char buf[64];
+ const char* p;
+ int fd,n,major,minor;
+
+ if ( (fd=open(dmiBios,O_RDONLY))<0 )
+   return 0x100;
+ n = read(fd,buf,sizeof(buf)-1);
+ close(fd);
+ buf[n>0 ? n : 0] = 0;
+ for (p=buf ; *p && (*p<'0' || *p>'9') ; p++)
+   ;
+ if ( sscanf(p,"%d.%d",&major,&minor)!=2 )
+   return 0x100;
+ return major*0x100 + minor;
+} /* sHciGetBiosVersion */
+
+/*
+ * there is no machine id to be had, so report a Toshiba BIOS with an id
+ * no model uses; the model then shows as unknown
+ */
+static int
+sHciGetMachineID(int *id)
+{
+ *id = SYSFS_MACHINE_ID;
+ return HCI_SUCCESS;
+} /* sHciGetMachineID */
+
+static int
+sSciSupportCheck(int *version)
+{
+ *version = 0;
+ return SCI_SUCCESS;
+} /* sSciSupportCheck */
+
+static int sSciOpenInterface()  { return SCI_SUCCESS; }
+static int sSciCloseInterface() { return SCI_SUCCESS; }
+
+/*
+ * read the attributes of registers ebx[0..n-1] in one batch
+ */
+static void
+sSciPrefetch(const unsigned short* ebx, int n)
+{
+ int   fd[SYSFS_MAX_ATTRS];
+ char* buf[SYSFS_MAX_ATTRS];
+ int   len[SYSFS_MAX_ATTRS];
+ int   res[SYSFS_MAX_ATTRS];
+ int   which[SYSFS_MAX_ATTRS];
+ int   queued[SYSFS_MAX_ATTRS];
+ int   i,j,m=0;
+
+ memset(queued,0,sizeof(queued));
+ for (j=0 ; j<n ; j++) {
+   if ( (i=attrFind(ebx[j]))<0 || queued[i] )
+     continue;
+   queued[i] = 1;         /* a register listed twice is read once */
+   fd[m]    = files[i].fd;
+   buf[m]   = files[i].buf;
+   len[m]   = SYSFS_BUF-1;
+   which[m] = i;
+   m++;
+ }
+ if ( m==0 )
+   return;
+ batchRead(m,fd,buf,len,res);
+ for (j=0 ; j<m ; j++)
+   files[which[j]].cached = res[j];
+} /* sSciPrefetch */
+
+static int
+sSciGet(SMMRegisters *reg)
+{
+ SysfsFile* f;
+ char* end;
+ long v;
+ int i,n;
+
+ if ( (i=attrFind(reg->ebx & 0xffff))<0 )
+   return sysfsReturn(reg,SCI_NOT_SUPPORTED);
+
+ // a prefetched answer is good for this one read
+ f = &files[i];
+ if ( (n=f->cached)==SYSFS_NOCACHE ) {
+   ssize_t r = pread(f->fd,f->buf,SYSFS_BUF-1,0);
+   n = r<0 ? -errno : (int) r;
+ }
+ f->cached = SYSFS_NOCACHE;
+ if ( n<0 )
+   return sysfsReturn(reg,errnoCode(-n));
+ f->buf[n] = 0;
+ v = strtol(f->buf,&end,10);
+ if ( end==f->buf )
+   return sysfsReturn(reg,SCI_DEVICE_ERROR);
+ if ( attrs[i].codes ) {
+   if ( v<0 || v>=attrs[i].numCodes )
+     return sysfsReturn(reg,SCI_DEVICE_ERROR);
+   v = attrs[i].codes[v];
+ }
+
+ reg->ecx = v;
+ reg->edx = 0;
+ return sysfsReturn(reg,SCI_SUCCESS);
+} /* sSciGet */
+
+static int
+sSciSet(SMMRegisters *reg)
+{
+ char buf[SYSFS_BUF];
+ unsigned int v = reg->ecx & 0xffff;
+ int i,j,len;
+
+ if ( (i=attrFind(reg->ebx & 0xffff))<0 )
+   return sysfsReturn(reg,SCI_NOT_SUPPORTED);
+ for (j=0 ; j<numAttrs ; j++)
+   files[j].cached = SYSFS_NOCACHE;
+ if ( !files[i].writable )
+   return sysfsReturn(reg,SCI_WRITE_PROTECTED);
+
+ if ( attrs[i].codes ) {
+   for (j=0 ; j<attrs[i].numCodes && attrs[i].codes[j]!=v ; j++)
+     ;
+   if ( j==attrs[i].numCodes )
+     return sysfsReturn(reg,SCI_INPUT_ERROR);
+   v = j;
+ }
+
+ len = snprintf(buf,sizeof(buf),"%u\n",v);
+ if ( pwrite(files[i].fd,buf,len,0)<0 )
+   return sysfsReturn(reg,errnoCode(errno));
+ return sysfsReturn(reg,SCI_SUCCESS);
+} /* sSciSet */
+
+const Transport sysfsTransport = {
+  "sysfs", TRANSPORT_BATCH,
+  sHciFunction, sHciGetBiosVersion, sHciGetMachineID,
+  sSciSupportCheck, sSciOpenInterface, sSciCloseInterface,
+  sSciGet, sSciSet, sSciPrefetch
+};
@@ -0,0 +1,21 @@
+
+#ifndef __sysfs_h__
+#define __sysfs_h__
+
+/*
+  settings through the sysfs attributes of the toshiba-tos1900 driver,
+for machines without /dev/toshiba; see sysfs.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 0 if the driver's attribute directory is there
+int sysfsInit();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __sysfs_h__ */
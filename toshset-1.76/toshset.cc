@@ -36,6 +36,9 @@ static char const rcsversion[]="$State: Exp $";
 #include <ctype.h>
 #include<errno.h>
 #include<signal.h>
+#include<time.h>
+#include<poll.h>
+#include<sys/timerfd.h>
 #include<paths.h>
 #include<pwd.h>
 #include <termios.h>
@@ -49,6 +52,8 @@ static char const rcsversion[]="$State: Exp $";
 #endif
 #include <iostream>
 #include <streambuf>
+#include <sstream>
+#include <algorithm>
 #include <iomanip>
 #include "cdsList.hh"
 #include "cdsString.hh"
@@ -59,21 +64,35 @@ static char const rcsversion[]="$State: Exp $";
 #endif
 
 #include "kernelInterface.h"
+#include "transport.h"
 #include "sci.h"
 #include "hci.h"
 #include "toshibaIDs.hh"
 #include "wildmat.h"
+#include "smmTrace.h"
+#include "smmStats.h"
+#include "chromeTrace.h"
+#include "profile.h"
+#include "smmCache.h"
+#include "queryRecord.h"
+#include "snapshot.h"
+#include "settingValues.h"
 
 using namespace std;
 
 enum { EMPTY, PRIMARY, AUXILLARY };
 
 static int id;
+static int bios;
 
 static char versionString[80];
 static int  verbose=0;
 static int  longQuery=0;
 static int  fast=0;
+static int  txn=0;
+static int  watchInterval=1000;   // ms
+static int  batchFailed=0;        // -batch commands which did not parse
+static int  outputFormat=OUTPUT_TEXT;
 
 
 
@@ -97,6 +116,28 @@ struct ValueSet {
     iString(input), sciCode(sciCode), oString(output) {}
 };
  
+//
+// what a feature read, before any formatting: the registers of its BIOS
+// call (ecx2/edx2 those of a second call, for features which need two,
+// or another register its text needs), and the index of the setting
+// among its values. Only what gets printed is turned into text, by
+// Feature::format().
+//
+struct QueryResult {
+  int          status;    // 0, or the error code read() returned
+  int          iface;     // RECORD_SCI, RECORD_HCI or RECORD_NONE
+  unsigned int ebx;
+  unsigned int ecx,edx;
+  unsigned int ecx2,edx2;
+  int          code;      // index into the feature's values, or -1
+  String       text;      // a reading which is text to begin with
+  QueryResult() : status(0), iface(RECORD_NONE), ebx(0), ecx(0), edx(0),
+		  ecx2(0), edx2(0), code(-1) {}
+  int operator==(const QueryResult& r) const
+    { return status==r.status && ecx==r.ecx && edx==r.edx &&
+	     ecx2==r.ecx2 && edx2==r.edx2 && code==r.code && text==r.text; }
+};
+ 
 struct Feature {
   const char* name;
   Feature(const char* name) : name(name) {}
@@ -104,10 +145,37 @@ struct Feature {
   // the next two return 0 on success, otherwise return an error code
   // which is interpreted using error()
   virtual int action(const char**) const=0; 
-  virtual int query(OStringStream &os) const=0;
+  virtual int read(QueryResult&) const=0;
   virtual const char* error(int) const=0;
+  // a successful read as "name: value"
+  virtual void format(const QueryResult&, OStringStream &os) const=0;
+  // the name of setting number code, for features with a list of them,
+  // and the argument which selects it
+  virtual const char* valueName(int code) const { return 0; }
+  virtual const char* valueArg(int code) const { return 0; }
+  // 1 if read() takes register value ecx to mean setting number code
+  virtual int isValue(int code, unsigned int ecx) const { return 0; }
+  // read() and format() together
+  int query(OStringStream &os) const;
+  // return 1 if action() with these arguments would change nothing.
+  // Features which cannot tell cheaply say 0, and are always set.
+  virtual int unchanged(const char**) const { return 0; }
+  // toshset's own options (-v, -fast...), as opposed to machine settings
+  virtual int local() const { return 0; }
+  // the SCI register read() reads, or -1
+  virtual int sciRegister() const { return -1; }
 };
 
+int
+Feature::query(OStringStream& os) const
+{
+ QueryResult r;
+ int ret = read(r);
+ if ( ret==0 )
+   format(r,os);
+ return ret;
+} /* Feature::query */
+
 struct ToggleFeature : public Feature {
   int&        toggleVar;
   //  const char* name;
@@ -117,8 +185,10 @@ struct ToggleFeature : public Feature {
   virtual ~ToggleFeature() {}
   virtual int action(const char**) const 
     { toggleVar = (toggleVar?0:1); return 1;}
-  virtual int query(OStringStream &os) const {return 1;}
+  virtual int read(QueryResult& r) const { return r.status=1; }
+  virtual void format(const QueryResult&, OStringStream&) const {}
   virtual const char* error(int) const {return "";}
+  virtual int local() const { return 1; }
 };
 
 struct VersionFeature : public Feature {
@@ -126,8 +196,9 @@ struct VersionFeature : public Feature {
     Feature("toshset version") {}
   virtual ~VersionFeature() {}
   virtual int action(const char**) const {return 1;}
-  virtual int query(OStringStream &os) const {
-   os << "toshset version: " << VERSION << ends; return 0;}
+  virtual int read(QueryResult&) const { return 0; }
+  virtual void format(const QueryResult&, OStringStream &os) const {
+   os << "toshset version: " << VERSION; }
   virtual const char* error(int) const {return "";}
 };
 
@@ -136,9 +207,9 @@ struct AccessFeature : public Feature {
     Feature("HCI/SCI access") {}
   virtual ~AccessFeature() {}
   virtual int action(const char**) const {return 1;}
-  virtual int query(OStringStream &os) const {
-   os << "HCI/SCI access mode: " 
-      << (accessMode==ACCESS_DIRECT?"direct":"kernel") << ends; return 0;}
+  virtual int read(QueryResult&) const { return 0; }
+  virtual void format(const QueryResult&, OStringStream &os) const {
+   os << "HCI/SCI access mode: " << transport->name; }
   virtual const char* error(int) const {return "";}
 };
 
@@ -148,8 +219,9 @@ struct ModelFeature : public Feature {
     Feature("hardware model"), id(id) {}
   virtual ~ModelFeature() {}
   virtual int action(const char**) const {return 1;}
-  virtual int query(OStringStream &os) const {
-   os << "Toshiba Model: " << toshibaModelName(id) << ends; return 0;}
+  virtual int read(QueryResult&) const { return 0; }
+  virtual void format(const QueryResult&, OStringStream &os) const {
+   os << "Toshiba Model: " << toshibaModelName(id); }
   virtual const char* error(int) const {return "";}
 };
 
@@ -167,10 +239,45 @@ struct SciFeature : public Feature {
   virtual ~SciFeature() 
     { for (int i=0 ; i<values.size() ; i++) delete values[i];}
   virtual int action(const char**) const;
-  virtual int query(OStringStream &os) const;
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream &os) const;
+  virtual const char* valueName(int code) const
+    { return code>=0 && code<values.size() ? values[code]->oString : 0; }
+  virtual const char* valueArg(int code) const
+    { return code>=0 && code<values.size() ? values[code]->iString : 0; }
+  virtual int isValue(int code, unsigned int ecx) const
+    { return code>=0 && code<values.size() && values[code]->sciCode==ecx; }
   const char*  error(int code) const;
+  virtual int unchanged(const char**) const;
+  virtual int sciRegister() const { return sciMode; }
+  int target(const char* s) const;
 };
 
+// index into values of the setting named (or numbered) s, or -1
+int
+SciFeature::target(const char* s) const
+{
+ for (int i=0 ; i<values.size() ; i++)
+   if ( strcmp( values[i]->iString , s ) == 0 )
+     return i;
+ errno=0;
+ int i = strtol(s,(char **)NULL,10);
+ if ( *s && errno==0 && i>=0 && i<values.size() ) 
+   return i;
+ return -1;
+} /* SciFeature::target */
+
+int
+SciFeature::unchanged(const char** s) const
+{
+ int i = target(*s);
+ if ( i<0 )
+   return 0;
+ SMMRegisters reg = { 0 };
+ reg.ebx = sciMode;
+ return SciGet( &reg )==SCI_SUCCESS && reg.ecx==values[i]->sciCode;
+} /* SciFeature::unchanged */
+
 const char*
 SciFeature::error(int code) const
 {
@@ -197,7 +304,7 @@ SciFeature::error(int code) const
 int
 SciFeature::action(const char **s) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
  if ( ! **s) {
    cerr << "SCI error: argument required\n";
@@ -238,25 +345,32 @@ SciFeature::action(const char **s) const
 } /* SciFeature::action */
 
 int
-SciFeature::query(OStringStream& os) const
+SciFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
- int ret = SciGet( &reg );
- if ( ret == SCI_SUCCESS ) {
-   for (int i=0 ; i<values.size() ; i++)
-     if ( reg.ecx == values[i]->sciCode ) {
-       os << name << ": " << values[i]->oString << ends;
-       return 0;
-     }
-   cerr << "SciFeature::query: received an unexpected response for feature " 
-	<< name << ": " << reg.ecx << '\n';
- } 
-//else 
-//   cerr << "SciFeature:query: error when querying feature " << name << '\n'
-//	  << "\tSciGet returned " << error(ret) << '\n';
- return ret;
-} /* SciFeature::action */
+ r.iface = RECORD_SCI;
+ r.ebx = sciMode;
+ if ( (r.status=SciGet( &reg )) != SCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ for (int i=0 ; i<values.size() ; i++)
+   if ( reg.ecx == values[i]->sciCode ) {
+     r.code = i;
+     return 0;
+   }
+ cerr << "SciFeature::query: received an unexpected response for feature " 
+      << name << ": " << reg.ecx << '\n';
+ return 0;
+} /* SciFeature::read */
+
+void
+SciFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ if ( r.code>=0 )
+   os << name << ": " << values[r.code]->oString;
+} /* SciFeature::format */
 
 struct TimeFeature : public SciFeature {
   TimeFeature(unsigned short sciMode,const char* name) :
@@ -264,7 +378,9 @@ struct TimeFeature : public SciFeature {
   virtual ~TimeFeature() 
     { for (int i=0 ; i<values.size() ; i++) delete values[i];}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
@@ -274,7 +390,7 @@ TimeFeature::action(const char **s) const
    cout << "<dis|HH:MM[/everyday|DD/MM[/YYYY]]> time/date to wake\n";
    return 0;
  }
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  enum {
    ALARM_TIME  = 0x0001,
    ALARM_DATE  = 0x0002,
@@ -361,39 +477,45 @@ TimeFeature::action(const char **s) const
 } /* TimeFeature::action */
 
 int
-TimeFeature::query(OStringStream& os) const
+TimeFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
- int ret = SciGet( &reg );
- if ( ret == SCI_SUCCESS ) {
-   os << name << ": ";
-   if ( reg.ecx == SCI_ALARM_DISABLED ) 
-     os << "disabled";
+ r.iface = RECORD_SCI;
+ r.ebx = sciMode;
+ if ( (r.status=SciGet( &reg )) != SCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ if ( reg.ecx != SCI_ALARM_DISABLED ) {
+   reg.ebx = SCI_ALARM_DATE;
+   SciGet( &reg );
+   r.ecx2 = reg.ecx;
+   r.edx2 = reg.edx;
+ }
+ return 0;
+} /* TimeFeature::read */
+
+void
+TimeFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ os << name << ": ";
+ if ( r.ecx == SCI_ALARM_DISABLED ) 
+   os << "disabled";
+ else {
+   os << setfill('0') << setw(2) << SCI_HOUR(r.ecx) << ':' 
+      << setfill('0') << setw(2) << SCI_MINUTE(r.ecx) << ' ';
+   int year = SCI_YEAR(r.ecx2);
+   if ( SCI_DATE_EVERYDAY(r.ecx2) )
+     os << "everyday";
    else {
-     os << setfill('0') << setw(2) << SCI_HOUR(reg.ecx) << ':' 
-	<< setfill('0') << setw(2) << SCI_MINUTE(reg.ecx) << ' ';
-     reg.ebx = SCI_ALARM_DATE;
-     SciGet( &reg );
-     int year = SCI_YEAR(reg.ecx);
-     if ( SCI_DATE_EVERYDAY(reg.ecx) )
-       os << "everyday";
-     else {
-       os << SCI_DAY(reg.ecx) << '/'
-	  << SCI_MONTH(reg.ecx);
-       if ( year !=1990 ) 
-	 os << year << '/';
-     }
+     os << SCI_DAY(r.ecx2) << '/'
+	<< SCI_MONTH(r.ecx2);
+     if ( year !=1990 ) 
+       os << year << '/';
    }
-   os << ends;
-   return 0;
- } 
- return ret;
-//else 
-//   cerr << "TimeFeature:query: error when querying feature " << name << '\n'
-//	  << "\tSciGet returned " << error(ret) << '\n';
-// return 0;
-} /* SciFeature::action */
+ }
+} /* TimeFeature::format */
 
 struct PasswdFeature : public SciFeature {
   unsigned short passwdType;
@@ -401,7 +523,9 @@ struct PasswdFeature : public SciFeature {
     SciFeature(SCI_PASSWORD,name), passwdType(passwdType) {}
   virtual ~PasswdFeature() {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 /*
@@ -498,7 +622,7 @@ static int
 setPasswd(char*          password,
 	  unsigned short passwdType)
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
 
  reg.eax = 0xf4f4;
  reg.ebx = SCI_PASSWORD;
@@ -536,7 +660,7 @@ PasswdFeature::action(const char **s) const
  }
  close(fd);
  
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
  reg.ecx = passwdType;
  int ret = SciGet( &reg );
@@ -574,49 +698,61 @@ PasswdFeature::action(const char **s) const
 } /* PasswdFeature::action */
 
 int
-PasswdFeature::query(OStringStream& os) const
+PasswdFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
  reg.ecx = passwdType;
- int ret = SciGet( &reg );
- if ( ret == SCI_SUCCESS ) {
-   os << name << ": ";
-   switch ( reg.ecx ) {
-     case 0 : os << "not registered"; break;
-     case 1 : os << "registered"; break;
-     default : os << "unexpected response: " << reg.ebx;
-   }
-   os << ends;
-   return 0;
- } 
-//else 
-//   cerr << "PasswdFeature:query: error when querying feature " << name << '\n'
-//	  << "\tSciGet returned " << error(ret) << '\n';
-// return 0;
- return ret;
-} /* PasswdFeature::query */
+ r.iface = RECORD_SCI;
+ r.ebx = sciMode;
+ if ( (r.status=SciGet( &reg )) != SCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ r.ecx2 = reg.ebx;        // shown when the answer makes no sense
+ return 0;
+} /* PasswdFeature::read */
+
+void
+PasswdFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ os << name << ": ";
+ switch ( r.ecx ) {
+   case 0 : os << "not registered"; break;
+   case 1 : os << "registered"; break;
+   default : os << "unexpected response: " << r.ecx2;
+ }
+} /* PasswdFeature::format */
 
 struct PercentFeature : public SciFeature {
   PercentFeature(unsigned short sciMode,const char* name) :
     SciFeature(sciMode,name) {}
   ~PercentFeature() {}
   int action(const char**) const {return 1;}
-  int query(OStringStream& os) const;
+  int read(QueryResult& r) const;
+  void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
-PercentFeature::query(OStringStream& os) const
+PercentFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.ebx = sciMode;
- int ret = SciGet( &reg );
- if ( ret == SCI_SUCCESS ) {
-   int percent = ((100*reg.ecx)/reg.edx);
-   os << name << ": " << percent << "\% " << ends;
- }
- return ret;
-} /* Feature::action */
+ r.iface = RECORD_SCI;
+ r.ebx = sciMode;
+ if ( (r.status=SciGet( &reg )) != SCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ return 0;
+} /* PercentFeature::read */
+
+void
+PercentFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ int percent = ((100*r.ecx)/r.edx);
+ os << name << ": " << percent << "\% ";
+} /* PercentFeature::format */
 
 
 struct HciFeature : public Feature {
@@ -631,10 +767,46 @@ struct HciFeature : public Feature {
   virtual ~HciFeature() 
     { for (int i=0 ; i<values.size() ; i++) delete values[i];}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
+  virtual const char* valueName(int code) const
+    { return code>=0 && code<values.size() ? values[code]->oString : 0; }
+  virtual const char* valueArg(int code) const
+    { return code>=0 && code<values.size() ? values[code]->iString : 0; }
+  virtual int isValue(int code, unsigned int ecx) const
+    { return code>=0 && code<values.size() && values[code]->sciCode==ecx; }
   virtual const char* error(int) const;
+  virtual int unchanged(const char**) const;
+  int target(const char* s) const;
 };
 
+// index into values of the setting named (or numbered) s, or -1
+int
+HciFeature::target(const char* s) const
+{
+ for (int i=0 ; i<values.size() ; i++)
+   if ( strcmp( values[i]->iString , s ) == 0 )
+     return i;
+ int i = atoi(s);
+ if ( isdigit(*s) && i>=0 && i<values.size() ) 
+   return i;
+ return -1;
+} /* HciFeature::target */
+
+int
+HciFeature::unchanged(const char** s) const
+{
+ int i = target(*s);
+ if ( i<0 )
+   return 0;
+ SMMRegisters reg = { 0 };
+ reg.eax = HCI_GET;
+ reg.ebx = hciMode;
+ reg.ecx = 0;
+ reg.edx = 0;
+ return HciFunction( &reg )==HCI_SUCCESS && reg.ecx==values[i]->sciCode;
+} /* HciFeature::unchanged */
+
 const char*
 HciFeature::error(int code) const
 {
@@ -656,7 +828,7 @@ HciFeature::error(int code) const
 int
 HciFeature::action(const char **s) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_SET;
  reg.ebx = hciMode;
  reg.edx = 0;
@@ -695,33 +867,37 @@ HciFeature::action(const char **s) const
 } /* Feature::action */
 
 int
-HciFeature::query(OStringStream& os) const
+HciFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 0;
- int ret=0;
- int retries=3;
- while ( --retries ) {
-   ret = HciFunction( &reg );
-   if ( ret != HCI_BUSY ) 
-     break;
- }
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
    
  // reg.ecx &= ~0x0080;  //this is some sort of status bit
- if ( ret == HCI_SUCCESS ) {
-   for (int i=0 ; i<values.size() ; i++)
-     if ( reg.ecx == values[i]->sciCode ) {
-       os << name << ": " << values[i]->oString << ends;
-       return 0;
-     }
-   cerr << "HciFeature::query: received an unexpected response for feature " 
-	<< name << ": " << reg.ecx << '\n';
- }
- return ret;
-} /* HciFeature::query */
+ for (int i=0 ; i<values.size() ; i++)
+   if ( reg.ecx == values[i]->sciCode ) {
+     r.code = i;
+     return 0;
+   }
+ cerr << "HciFeature::query: received an unexpected response for feature " 
+      << name << ": " << reg.ecx << '\n';
+ return 0;
+} /* HciFeature::read */
+
+void
+HciFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ if ( r.code>=0 )
+   os << name << ": " << values[r.code]->oString;
+} /* HciFeature::format */
 
 // are these really constant??
 const int HCI_LCD_BRIGHTNESS_BITS   =		3;
@@ -733,13 +909,15 @@ struct LCDIntensityFeature : public HciFeature {
   LCDIntensityFeature(const char* name) :
     HciFeature(HCI_LCD_BRIGHTNESS,name) {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
 LCDIntensityFeature::action(const char **s) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_SET;
  reg.ebx = hciMode;
  reg.edx = 0;
@@ -767,24 +945,29 @@ LCDIntensityFeature::action(const char **s) const
 } /* LCDIntensityFeature::action */
 
 int
-LCDIntensityFeature::query(OStringStream& os) const
+LCDIntensityFeature::read(QueryResult& r) const
 {
-
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 0;
- int ret=0;
- ret = HciFunction( &reg );
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
  // reg.ecx &= ~0x0080;  //this is some sort of status bit
- if ( ret == HCI_SUCCESS ) {
-   int value = reg.ecx >> HCI_LCD_BRIGHTNESS_SHIFT;
-   os << name << ": " << value << "/" << (HCI_LCD_BRIGHTNESS_LEVELS-1) << ends;
-   return 0;
- }
- return ret;
-} /* LCDIntensityFeature::query */
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ return 0;
+} /* LCDIntensityFeature::read */
+
+void
+LCDIntensityFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ int value = r.ecx >> HCI_LCD_BRIGHTNESS_SHIFT;
+ os << name << ": " << value << "/" << (HCI_LCD_BRIGHTNESS_LEVELS-1);
+} /* LCDIntensityFeature::format */
 
 struct WirelessFeature : public HciFeature {
   int mode;
@@ -792,13 +975,15 @@ struct WirelessFeature : public HciFeature {
 		  const char* name) :
     HciFeature(HCI_WIRELESS,name), mode(mode) {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
 WirelessFeature::action(const char **s) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_SET;
  reg.ebx = hciMode;
  reg.edx = mode;
@@ -837,43 +1022,100 @@ WirelessFeature::action(const char **s) const
 } /* WirelessFeature::action */
 
 int
-WirelessFeature::query(OStringStream& os) const
+WirelessFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 1;
  reg.edx = mode;
- int ret=0;
- ret = HciFunction( &reg );
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS )
+   return r.status;
 // cerr << "cx: " << reg.ecx <<endl;
 // cerr << "dx: " << reg.edx <<endl;
- if (  ret!=0 )  return ret;
- 
- if ( ret != HCI_SUCCESS )
-   return ret;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
+ return 0;
+} /* WirelessFeature::read */
 
+void
+WirelessFeature::format(const QueryResult& r, OStringStream& os) const
+{
  os << name << ": ";
- if (!(reg.ecx & 0x0f))
+ if (!(r.ecx & 0x0f))
    os << "unavailable";
  else
-   os << (reg.ecx&1 ? "on":"off");
- os << ends;
- return ret;
-
-} /* WirelessFeature::query */
+   os << (r.ecx&1 ? "on":"off");
+} /* WirelessFeature::format */
 
 struct BlueToothFeature : public HciFeature {
   BlueToothFeature(const char* name) :
     HciFeature(HCI_WIRELESS,name) {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
+  int waitState(unsigned int mask, unsigned int want, const char* what) const;
 };
 
+//
+// the device takes a while to power up before it can be attached (and to
+// detach before it can be powered down). Rather than sleeping a fixed
+// second, poll the status bits: often at first, then less often, until
+// they read as wanted or BT_SETTLE_MS has passed.
+//
+#define BT_SETTLE_MS    2000
+#define BT_POLL_MIN_US  500
+#define BT_POLL_MAX_US  50000
+
+int
+BlueToothFeature::waitState(unsigned int mask,
+			    unsigned int want,
+			    const char*  what) const
+{
+ CTraceSpan span(what,"wait");
+ struct timespec start, now;
+ long pollUs = BT_POLL_MIN_US;
+ long elapsedUs;
+ SMMRegisters reg = { 0 };
+ int ret;
+
+ clock_gettime(CLOCK_MONOTONIC,&start);
+ for (;;) {
+   reg.eax = HCI_GET;
+   reg.ebx = hciMode;
+   reg.ecx = 0;
+   reg.edx = 1;
+   smmCacheFlush();     // the state is changing: always ask the BIOS
+   ret = HciFunction( &reg );
+   clock_gettime(CLOCK_MONOTONIC,&now);
+   elapsedUs = (now.tv_sec-start.tv_sec)*1000000L +
+	       (now.tv_nsec-start.tv_nsec)/1000;
+   if ( ret!=HCI_SUCCESS )
+     return ret;
+   if ( (reg.ecx & mask)==want ) {
+     if ( verbose )
+       cerr << "bluetooth: " << what << " after " 
+	    << elapsedUs/1000.0 << " ms\n";
+     return HCI_SUCCESS;
+   }
+   if ( elapsedUs+pollUs > BT_SETTLE_MS*1000L ) {
+     cerr << "bluetooth: timed out waiting for " << what << '\n';
+     return HCI_NOTREADY;
+   }
+   usleep(pollUs);
+   pollUs += pollUs/2;
+   if ( pollUs>BT_POLL_MAX_US )
+     pollUs = BT_POLL_MAX_US;
+ }
+} /* BlueToothFeature::waitState */
+
 int
 BlueToothFeature::action(const char** c) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
@@ -920,7 +1162,8 @@ BlueToothFeature::action(const char** c) const
 
    // HciFunction( 0 );
 
-   sleep(1);
+   if ( (ret=waitState(0x80,0x80,"power on"))!=HCI_SUCCESS )
+     return ret;
 
    reg.eax = HCI_SET;
    reg.ebx = hciMode;
@@ -932,6 +1175,8 @@ BlueToothFeature::action(const char** c) const
      cerr << "error attaching Bluetooth device\n";
      return ret;
    }
+   if ( (ret=waitState(0x40,0x40,"attach"))!=HCI_SUCCESS )
+     return ret;
    //cerr << "wireless switch is attached\n";
  }
  if ( (String(*c) == "off") ||
@@ -947,7 +1192,8 @@ BlueToothFeature::action(const char** c) const
      return ret;
    }
 
-   sleep(1);
+   if ( (ret=waitState(0x40,0,"detach"))!=HCI_SUCCESS )
+     return ret;
 
    reg.eax = HCI_SET;
    reg.ebx = hciMode;
@@ -959,6 +1205,8 @@ BlueToothFeature::action(const char** c) const
      cerr << "error deactivating Bluetooth device\n";
      return ret;
    }
+   if ( (ret=waitState(0x80,0,"power off"))!=HCI_SUCCESS )
+     return ret;
    //cerr << "wireless switch is activated\n";
 
    // HciFunction( 0 );
@@ -971,62 +1219,67 @@ BlueToothFeature::action(const char** c) const
 } /* BlueToothFeature::action */
 
 int
-BlueToothFeature::query(OStringStream& os) const
+BlueToothFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 0;
- int ret=0;
- ret = HciFunction( &reg );
- if (  ret!=0 ) {
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS ) {
    //   cerr << "error querying bluetooth\n";
-   return ret;
+   return r.status;
  }
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
  if (!(reg.ecx & 0x0f)) {
    cerr << "Bluetooth unavailable\n";
-   return ret;
+   return 0;
  }
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 1;
- ret=0;
- ret = HciFunction( &reg );
- if ( ret!=0 ) {
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS ) {
    cerr << "error checking Bluetooth switch status\n";
-   return ret;
+   return r.status;
  }
+ r.ecx2 = reg.ecx;
+ r.edx2 = reg.edx;
+ return 0;
+} /* BlueToothFeature::read */
+
+void
+BlueToothFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ if (!(r.ecx & 0x0f))
+   return;
  os << "bluetooth: ";
- if(!(reg.ecx & 0x1)) {
+ if(!(r.ecx2 & 0x1))
    os << "wireless switch is off\n";
-   return ret;
- }
- if(!(reg.ecx & 0x80)) {
+ else if(!(r.ecx2 & 0x80))
    os << "power is off\n";
-   return ret;
- }
- if(!(reg.ecx & 0x40)) {
+ else if(!(r.ecx2 & 0x40))
    os << "interface detached";
-   return ret;
- }
-
- os << "attached";
- return ret;
-} /* BlueToothFeature::query */
+ else
+   os << "attached";
+} /* BlueToothFeature::format */
 
 struct ThreeGRFFeature : public HciFeature {
   ThreeGRFFeature(const char* name) :
     HciFeature(HCI_WIRELESS,name) {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
 ThreeGRFFeature::action(const char** c) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
@@ -1088,86 +1341,105 @@ return ret;
 } /* ThreeGRFFeature::action */
 
 int
-ThreeGRFFeature::query(OStringStream& os) const
+ThreeGRFFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 0;
- int ret=0;
- ret = HciFunction( &reg );
- if (  ret!=0 ) {
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS ) {
    //   cerr << "error querying 3g modem\n";
-   return ret;
+   return r.status;
  }
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
  if (!(reg.ecx & 0x0f)) { //At the modem this is the same as bluetooth
 	                  //I don't know how to check for 3g modem presence
    cerr << "3g modem unavailable\n";
-   return ret;
+   return 0;
  }
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
  reg.edx = 1;
- ret=0;
- ret = HciFunction( &reg );
- if ( ret!=0 ) {
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS ) {
    cerr << "error checking 3g switch status\n";
-   return ret;
+   return r.status;
  }
+ r.ecx2 = reg.ecx;
+ r.edx2 = reg.edx;
+ return 0;
+} /* ThreeGRFFeature::read */
+
+void
+ThreeGRFFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ if (!(r.ecx & 0x0f))
+   return;
  os << "3g modem: ";
- if(!(reg.ecx & 0x1)) {
+ if(!(r.ecx2 & 0x1))
    os << "wireless switch is off\n";
-   return ret;
- }
- if(!(reg.ecx & 0x2000)) {
+ else if(!(r.ecx2 & 0x2000))
    os << "off";
-   return ret;
- }
-
- os << "on";
- return ret;
-} /* ThreeGRFFeature::query */
+ else
+   os << "on";
+} /* ThreeGRFFeature::format */
 
 
 
 struct VideoFeature : public HciFeature {
   VideoFeature(unsigned short hciMode,const char* name) :
     HciFeature(hciMode,name) {}
-  virtual int query(OStringStream& os) const;
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
+  virtual int isValue(int code, unsigned int ecx) const
+    { return HciFeature::isValue(code,ecx & ~0x0080); }
 };
 
 int
-VideoFeature::query(OStringStream& os) const
+VideoFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
  reg.ecx = 0;
- int ret=0;
- ret = HciFunction( &reg );
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) != HCI_SUCCESS )
+   return r.status;
+ r.ecx = reg.ecx;
+ r.edx = reg.edx;
  reg.ecx &= ~0x0080;  //this is some sort of status bit
- if ( ret == HCI_SUCCESS ) {
-   for (int i=0 ; i<values.size() ; i++)
-     if ( reg.ecx == values[i]->sciCode ) {
-       os << name << ": " << values[i]->oString << ends;
-       return 0;
-     }
-   cerr << "VideoFeature::query: received an unexpected response for feature " 
-	<< name << ": " << reg.ecx << '\n';
- }
- return ret;
-} /* VideoFeature::query */
+ for (int i=0 ; i<values.size() ; i++)
+   if ( reg.ecx == values[i]->sciCode ) {
+     r.code = i;
+     return 0;
+   }
+ cerr << "VideoFeature::query: received an unexpected response for feature " 
+      << name << ": " << reg.ecx << '\n';
+ return 0;
+} /* VideoFeature::read */
+
+void
+VideoFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ if ( r.code>=0 )
+   os << name << ": " << values[r.code]->oString;
+} /* VideoFeature::format */
 
 struct LbaFeature : public HciFeature {
   LbaFeature(unsigned short hciMode,const char* name) :
     HciFeature(hciMode,name) {}
   virtual ~LbaFeature() {}
 
+  virtual int unchanged(const char**) const { return 0; }
+
   //  virtual int action(const char**) const;
   virtual int action(const char **s) const {
-   SMMRegisters reg;
+   SMMRegisters reg = { 0 };
    reg.eax = HCI_SET;
    reg.ebx = hciMode;
    reg.edx = 0;
@@ -1192,17 +1464,21 @@ struct LbaFeature : public HciFeature {
    }
   };
 
-  virtual int query(OStringStream& os) const {
-   SMMRegisters reg;
+  virtual int read(QueryResult& r) const {
+   SMMRegisters reg = { 0 };
    reg.eax = HCI_GET;
    reg.ebx = hciMode;
    reg.ecx = 0;
-   int ret = HciFunction( &reg );
-   if ( ret == HCI_SUCCESS ) {
-     os << name << ": 0x" << hex << reg.ecx << dec << " (" << reg.ecx << ")";
-     return 0;
+   r.iface = RECORD_HCI;
+   r.ebx = hciMode;
+   if ( (r.status=HciFunction( &reg )) == HCI_SUCCESS ) {
+     r.ecx = reg.ecx;
+     r.edx = reg.edx;
    } 
-   return ret;
+   return r.status;
+  }
+  virtual void format(const QueryResult& r, OStringStream& os) const {
+   os << name << ": 0x" << hex << r.ecx << dec << " (" << r.ecx << ")";
   }
 };
 
@@ -1212,9 +1488,11 @@ struct HibInfoFeature : public HciFeature {
     HciFeature(HCI_HIBERNATION_INFO,name), hibInfoMode(hibInfoMode) {}
   virtual ~HibInfoFeature() {}
 
+  virtual int unchanged(const char**) const { return 0; }
+
   //  virtual int action(const char**) const;
   virtual int action(const char **s) const {
-   SMMRegisters reg;
+   SMMRegisters reg = { 0 };
    reg.eax = HCI_SET;
    reg.ebx = hciMode;
    reg.ecx = 0;
@@ -1246,17 +1524,21 @@ struct HibInfoFeature : public HciFeature {
    }
   };
 
-  virtual int query(OStringStream& os) const {
-   SMMRegisters reg;
+  virtual int read(QueryResult& r) const {
+   SMMRegisters reg = { 0 };
    reg.eax = HCI_GET;
    reg.ebx = hciMode;
    reg.ecx = hibInfoMode;
-   int ret = HciFunction( &reg );
-   if ( ret == HCI_SUCCESS ) {
-     os << name << ": " << reg.ecx;
-     return 0;
+   r.iface = RECORD_HCI;
+   r.ebx = hciMode;
+   if ( (r.status=HciFunction( &reg )) == HCI_SUCCESS ) {
+     r.ecx = reg.ecx;
+     r.edx = reg.edx;
    }
-   return ret;
+   return r.status;
+  }
+  virtual void format(const QueryResult& r, OStringStream& os) const {
+   os << name << ": " << r.ecx;
   }
 }; // HibInfoFeature
    
@@ -1266,13 +1548,95 @@ struct OwnerStringFeature : public HciFeature {
     HciFeature(hciMode,name) {}
   virtual ~OwnerStringFeature() {}
   virtual int action(const char**) const;
-  virtual int query(OStringStream& os) const;
+  virtual int unchanged(const char**) const { return 0; }
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
+  int maxLength(int* length) const;
+  int read(char* buf, int length, int* used) const;
+  int write(const char* buf, const char* old, int oldUsed, 
+	    int length) const;
 };
 
+//
+// The owner string is moved through edx, 4 bytes per HCI call at offset
+// esi; the registers leave no room for a larger chunk. So reads stop at
+// the word holding the terminating NUL, and writes send only the words
+// which differ from what the firmware already holds.
+//
+
+int
+OwnerStringFeature::maxLength(int* length) const
+{
+ SMMRegisters reg = { 0 };
+ reg.eax = HCI_GET;
+ reg.ebx = hciMode;
+ reg.ecx = 0;
+ reg.esi = 0;
+ int ret = HciFunction( &reg );
+ *length = (reg.ecx & 0xffff0000)>>16;
+ return ret;
+} /* OwnerStringFeature::maxLength */
+
+// read into buf (length bytes, zero filled past what is read); *used is
+// set to the number of bytes read, a multiple of 4
+int
+OwnerStringFeature::read(char* buf,
+			 int   length,
+			 int*  used) const
+{
+ SMMRegisters reg = { 0 };
+ memset(buf,0,length);
+ *used = 0;
+ for (int i=0 ; i+4<=length ; i+=4) {
+   reg.eax = HCI_GET;
+   reg.ebx = hciMode;
+   reg.ecx = 4;
+   reg.esi = (unsigned long) i;
+   int ret = HciFunction( &reg );
+   if ( ret != HCI_SUCCESS )
+     return ret;
+   memcpy(buf+i,&reg.edx,4);
+   *used = i+4;
+   if ( memchr(buf+i,0,4) )
+     break;
+ }
+ return HCI_SUCCESS;
+} /* OwnerStringFeature::read */
+
+// write the words of buf up to and including its terminator, and clear
+// any further words that still hold part of the old string
+int
+OwnerStringFeature::write(const char* buf,
+			  const char* old,
+			  int         oldUsed,
+			  int         length) const
+{
+ SMMRegisters reg = { 0 };
+ int end = strnlen(buf,length)+1;
+ if ( end<oldUsed )
+   end = oldUsed;
+ for (int i=0 ; i<end && i+4<=length ; i+=4) {
+   if ( memcmp(buf+i,old+i,4)==0 )
+     continue;
+   reg.eax = HCI_SET;
+   reg.ebx = hciMode;
+   reg.ecx = 4;
+   reg.esi = i;
+   memcpy(&reg.edx,buf+i,4);
+   int ret = HciFunction(&reg);
+   if ( ret != HCI_SUCCESS ) {
+     cerr << "HCI error setting feature " << name << '\n'
+	  << "\tHciFunction returned " << error(ret) 
+	  << " for i= " << i << '\n';
+     return ret;
+   }
+ }
+ return HCI_SUCCESS;
+} /* OwnerStringFeature::write */
+
 int
 OwnerStringFeature::action(const char **s) const
 {
- SMMRegisters reg;
  String str(*s);
  str.gsub("\\n","\n\r");       //deal w newlines and tabs
  str.gsub("\\t" ,"        "); 
@@ -1285,111 +1649,61 @@ OwnerStringFeature::action(const char **s) const
  // str.gsub("\t","        "); 
  const char* p=str;
  // cout << "setting owner string to " << p << '\n';
- if ( strlen(p) > 512 ) {//FIX: should query for this
-   cerr << "string too long\n";
+ int length;
+ if ( maxLength(&length) != HCI_SUCCESS ) {
+   cerr << "unable to query length of " << name << '\n';
    return 0;
  }
- int allowedFailures=30;
- for (int i=0 ; i<512 ; i+=4) {
-   reg.eax = HCI_SET;
-   reg.ebx = HCI_OWNERSTRING;
-   reg.ecx = 4;
-   reg.esi = i;
-   reg.edx = 0;
-   for (int j=0 ; j<4 ; j++,p++) {
-     unsigned int tmp=0;
-     tmp |= *p;
-     tmp = tmp<<8*j;
-     reg.edx |= tmp;
-     if ( !*p) {
-//	 reg.edx = reg.edx<<(3-j)*8;
-	 break;
-     }
-   }
-   //   cout << "edx: " << hex << reg.edx << dec << '\n';
-   int ret = HciFunction(&reg);
-   if ( ret != HCI_SUCCESS ) {
-     allowedFailures--;
-     if ( allowedFailures<=0 ) {
-       cerr << "too many HCI errors setting feature " << name << '\n'
-	    << "\tHciFunction returned " << error(ret) 
-	    << " for i= " << i << '\n';
-       return 0;
-     }
-     i -= 4;
-     p -= 4;
-   }
-//     cerr << "HCI error setting feature " << name << '\n'
-//	    << "\tHciFunction returned " << error(ret) 
-//	    << "for i= " << i << '\n';
-//     return 0;
+ length &= ~3;
+ if ( (int)strlen(p) > length ) {
+   cerr << "string too long: at most " << length << " characters\n";
+   return 0;
  }
- return 1;
+ char* cur = new char[length+4];
+ char* buf = new char[length+4];
+ int used;
+ int ret = read(cur,length,&used);
+ if ( ret != HCI_SUCCESS ) {
+   // unknown contents: rewrite it all
+   memset(cur,0xff,length);
+   used = length;
+ }
+ memset(buf,0,length);
+ memcpy(buf,p,strlen(p));
+ ret = write(buf,cur,used,length);
+ delete [] cur;
+ delete [] buf;
+ return ret==HCI_SUCCESS;
 } /* OwnerStringFeature::action */
 
 int
-OwnerStringFeature::query(OStringStream& os) const
+OwnerStringFeature::read(QueryResult& r) const
+{
+ int length;
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=maxLength(&length)) != HCI_SUCCESS )
+   return r.status;
+ r.ecx = length;
+
+ char* buf = new char[length+5];
+ int used;
+ if ( read(buf,length,&used) != HCI_SUCCESS )
+   cerr << "error in query...\n";
+ buf[length] = 0;
+ r.text = buf;
+ delete [] buf;
+ return 0;
+} /* OwnerStringFeature::read */
+
+void
+OwnerStringFeature::format(const QueryResult& r, OStringStream& os) const
 {
- SMMRegisters reg;
- reg.eax = HCI_GET;
- reg.ebx = hciMode;
- reg.ecx = 0;
- reg.esi = 0;
- int ret = HciFunction( &reg );
  os << name << ": ";
- if ( ret == HCI_SUCCESS ) {
-   int length = (reg.ecx & 0xffff0000)>>16;
-   
-   os << "[ max length: " << length << ']' << '\n';
-
-   for (int i=0 ; i<length ; i+=4) {
-     reg.eax = HCI_GET;
-     reg.ebx = hciMode;
-     reg.ecx = 4;
-     reg.esi = (unsigned long) i;
-     if ( HciFunction( &reg ) != HCI_SUCCESS ) {
-       // i -= 4;
-       cerr << "error in query...\n";
-       break;
-     } else {
-       //int valid = reg.ecx & 0xffff;
-       if ( reg.edx == 0x0000 ) {
-	 os << '\n' << ends;
-	 return 0;
-       }
-       //printf("index=%d  valid=%d\n", reg.esi, valid);
-       unsigned int characters = reg.edx;
-       for (int j=0 ; j<4 ; j++) {
-	 char c = (char) characters & 0xff;
-	 os << c;
-	 //printf("%02x ", c);
-	 characters = characters >> 8;
-       }
-       
-       //     if ((c>=0x20) && (c<=0x80))
-//	 *(string++) = c;
-       //     if (c==0x0d)
-//	 *(string++) = c;
-     }
-   }
-//   char temp[5];
-//   memcpy(temp,&reg.ecx,4);
-//   temp[4]='\0';
-//   os << name << ": " << temp[0] << temp[1] << temp[2] << temp[3] << '\n';
-//   os << reg.ecx << '\n' << ends;
-//   cout	<< name << ": " << temp[3] << '\n';
-//   cout	<< reg.ecx << '\n';
-   //os << name << ':' << ( reg.cx?(char*)reg.cx:(char*)"" ) << ends;
-   os << '\n';
- } 
- os << ends;
-//else {
-//   cerr << "HciFeature::query: HciFunction for feature "
-//	  << name << " returned " << error(ret) << '\n';
-//   return 0;
-// }
- return ret;
-} /* OwnerStringFeature::query */
+ os << "[ max length: " << r.ecx << ']' << '\n';
+ os << r.text;
+ os << '\n';
+} /* OwnerStringFeature::format */
 
 struct LCDFeature : public HciFeature {
   LCDFeature(unsigned short hciMode,const char* name) :
@@ -1401,46 +1715,53 @@ struct LCDFeature : public HciFeature {
     { values.append(new ValueSet(input,hciCode,output)); }
   virtual ~LCDFeature() {}
   virtual int action(const char**) const { return 0; }
-  virtual int query(OStringStream& os) const;
+  virtual int read(QueryResult& r) const;
+  virtual void format(const QueryResult& r, OStringStream& os) const;
 };
 
 int
-LCDFeature::query(OStringStream& os) const
+LCDFeature::read(QueryResult& r) const
 {
- SMMRegisters reg;
+ SMMRegisters reg = { 0 };
  reg.eax = HCI_GET;
  reg.ebx = hciMode;
- int ret = HciFunction( &reg );
- if ( ret == HCI_SUCCESS ) {
-   os << name << ": ";
-   switch ( (reg.ecx & 0xff00)>>8 ) {
-     case HCI_640_480 : os << " 640x480, "; break;
-     case HCI_800_600 : os << " 800x600, "; break;
-     case HCI_1024_768: os << "1024x768, "; break;
-     case HCI_1024_600: os << "1024x600, "; break;
-     case HCI_800_480 : os << " 800x480, "; break;
-     case HCI_1400_1050 : os << " 1400x1050, "; break;
-     case HCI_1600_1200 : os << " 1600x1200, "; break;
-     case HCI_1280_600  : os << " 1280x600, "; break;
-     case HCI_1280_800  : os << " 1280x800, "; break;
-     case HCI_1440_900  : os << " 1440x900, "; break;
-     case HCI_1920_1200 : os << " 1920x1200, "; break;
-     default: os << "resolution (" << ((reg.ecx & 0xff00)>>8 ) << ") unknown";
-   }
-   switch ( reg.ecx & 0xff ) {
-     case HCI_STN_MONO   : os << "mono STN  "; break;
-     case HCI_STN_COLOUR : os << "colour STN"; break;
-     case HCI_9BIT_TFT   : os << "9 bit TFT "; break; 
-     case HCI_12BIT_TFT  : os << "12 bit TFT"; break; 
-     case HCI_18BIT_TFT  : os << "18 bit TFT"; break; 
-     case HCI_24BIT_TFT  : os << "24 bit TFT"; break;	   
-     default: os << "type (" << (reg.ecx&0xff) << ") unknown";
-   }
-   os << ends;
-   return 0;
+ r.iface = RECORD_HCI;
+ r.ebx = hciMode;
+ if ( (r.status=HciFunction( &reg )) == HCI_SUCCESS ) {
+   r.ecx = reg.ecx;
+   r.edx = reg.edx;
  }
- return ret;
-} /* LCDFeature::query */
+ return r.status;
+} /* LCDFeature::read */
+
+void
+LCDFeature::format(const QueryResult& r, OStringStream& os) const
+{
+ os << name << ": ";
+ switch ( (r.ecx & 0xff00)>>8 ) {
+   case HCI_640_480 : os << " 640x480, "; break;
+   case HCI_800_600 : os << " 800x600, "; break;
+   case HCI_1024_768: os << "1024x768, "; break;
+   case HCI_1024_600: os << "1024x600, "; break;
+   case HCI_800_480 : os << " 800x480, "; break;
+   case HCI_1400_1050 : os << " 1400x1050, "; break;
+   case HCI_1600_1200 : os << " 1600x1200, "; break;
+   case HCI_1280_600  : os << " 1280x600, "; break;
+   case HCI_1280_800  : os << " 1280x800, "; break;
+   case HCI_1440_900  : os << " 1440x900, "; break;
+   case HCI_1920_1200 : os << " 1920x1200, "; break;
+   default: os << "resolution (" << ((r.ecx & 0xff00)>>8 ) << ") unknown";
+ }
+ switch ( r.ecx & 0xff ) {
+   case HCI_STN_MONO   : os << "mono STN  "; break;
+   case HCI_STN_COLOUR : os << "colour STN"; break;
+   case HCI_9BIT_TFT   : os << "9 bit TFT "; break; 
+   case HCI_12BIT_TFT  : os << "12 bit TFT"; break; 
+   case HCI_18BIT_TFT  : os << "18 bit TFT"; break; 
+   case HCI_24BIT_TFT  : os << "24 bit TFT"; break;	   
+   default: os << "type (" << (r.ecx&0xff) << ") unknown";
+ }
+} /* LCDFeature::format */
 
 
 class CmdLineArg {
@@ -1452,15 +1773,146 @@ public:
   virtual void        action(const int&,
 			     const char**) =0;
   virtual const char* name() const { return ""; }
+  // how many of the left arguments which follow the flag it takes
+  virtual int         argsTaken(int left) const
+    { return left<numArgs() ? left : numArgs(); }
+  // whether main() sets it up before the command line is processed
+  virtual int         early() const { return 0; }
+};
+
+//
+// the options sorted by flag, and by the feature they set, built once so
+// that parsing a flag or finding the flag of a feature is a binary search
+// rather than a scan of the whole option list. Features are matched by
+// their name pointer, which every ArgSet shares with its feature.
+//
+class FlagIndex {
+  struct Entry {
+    const char* key;
+    CmdLineArg* op;
+    int         pos;     // in the option list: later wins for names
+  };
+  Entry* byFlag;
+  Entry* byName;
+  int    num;
+  static int cmpFlag(const void* a, const void* b);
+  static int cmpName(const void* a, const void* b);
+public:
+  FlagIndex(CmdLineArg** options);
+  ~FlagIndex() { delete [] byFlag; delete [] byName; }
+  CmdLineArg* find(const char* flag) const;
+  const char* flagFor(const char* name) const;
+};
+
+int
+FlagIndex::cmpFlag(const void* a, const void* b)
+{
+ return strcmp(((const Entry*)a)->key,((const Entry*)b)->key);
+} /* FlagIndex::cmpFlag */
+
+int
+FlagIndex::cmpName(const void* a, const void* b)
+{
+ const Entry* x = (const Entry*)a;
+ const Entry* y = (const Entry*)b;
+ if ( x->key!=y->key )
+   return (unsigned long)x->key<(unsigned long)y->key ? -1 : 1;
+ return x->pos-y->pos;
+} /* FlagIndex::cmpName */
+
+FlagIndex::FlagIndex(CmdLineArg** options)
+{
+ for (num=0 ; options[num] ; num++)
+   ;
+ byFlag = new Entry[num];
+ byName = new Entry[num];
+ for (int i=0 ; i<num ; i++) {
+   byFlag[i].key = options[i]->flag();
+   byName[i].key = options[i]->name();
+   byFlag[i].op  = byName[i].op  = options[i];
+   byFlag[i].pos = byName[i].pos = i;
+ }
+ qsort(byFlag,num,sizeof(Entry),cmpFlag);
+ qsort(byName,num,sizeof(Entry),cmpName);
+} /* FlagIndex::FlagIndex */
+
+// the option for flag, or 0
+CmdLineArg*
+FlagIndex::find(const char* flag) const
+{
+ Entry key = { flag, 0, 0 };
+ Entry* e = (Entry*)bsearch(&key,byFlag,num,sizeof(Entry),cmpFlag);
+ return e ? e->op : 0;
+} /* FlagIndex::find */
+
+// the flag which sets the feature called name, or ""
+const char*
+FlagIndex::flagFor(const char* name) const
+{
+ int lo=0, hi=num;
+
+ // the last of the entries for name
+ while ( lo<hi ) {
+   int mid = (lo+hi)/2;
+   if ( (unsigned long)byName[mid].key<=(unsigned long)name )
+     lo = mid+1;
+   else
+     hi = mid;
+ }
+ if ( lo>0 && byName[lo-1].key==name )
+   return byName[lo-1].op->flag();
+ return "";
+} /* FlagIndex::flagFor */
+
+// the index of toshset's one option list
+static const FlagIndex&
+flagIndex(CmdLineArg** options)
+{
+ static FlagIndex* index=0;
+ if ( !index )
+   index = new FlagIndex(options);
+ return *index;
+} /* flagIndex */
+
+// the positions in argv of the early flags (-stats, -txn, ...), found by
+// walking it as CmdLineArgs::process() does, so that a flag given as
+// another option's argument (-ostring -txn) is only that argument
+static void
+findEarlyFlags(int argc, const char** argv, CmdLineArg** options,
+	       CDSList<int>& found)
+{
+ for (int i=1 ; i<argc ; i++) {
+   if ( argv[i][0]!='-' )
+     continue;
+   CmdLineArg* op = flagIndex(options).find(argv[i]);
+   if ( !op )
+     continue;                   // process() reports it
+   if ( op->early() )
+     found.append(i);
+   i += op->argsTaken(argc-i-1);
+ }
+} /* findEarlyFlags */
+
+//
+// thrown by an option which cannot be carried out, once it has said why
+// on cerr: CmdLineArgs::process() exits with status, or, for -batch,
+// fails just that command line
+//
+struct CmdLineFailure {
+  int status;
+  CmdLineFailure(int status) : status(status) {}
 };
 
 class CmdLineArgs {
   CDSList<const char*> argList;
   const char*        path;
   CmdLineArg** options;
+  int          fatal;   // errors exit, rather than failing process()
 public:
   CmdLineArgs(const char*        path,
-		    CmdLineArg** options) : path(path), options(options) {}
+		    CmdLineArg** options,
+		    int          fatal=1) : 
+    path(path), options(options), fatal(fatal) {}
 
   int process(const int          argc,
 	      const char**       argv);
@@ -1484,6 +1936,8 @@ void
 CmdLineArgs::error(const char *err)
 {
  cerr << "Command line error: " << err << '\n';
+ if ( !fatal )
+   return;
  usage();
  exit(2);
 }
@@ -1497,26 +1951,31 @@ CmdLineArgs::process(const int          argc,
  const char **argvp = argv;
  int ret=1;
 
+ // one allocation, however long a scripted command line gets
+ argList.setBlockSize(argc);
  while (argvp++ , (argcnt--) > 0) {
    if (**argvp == '-') {
-     int ok=0;
-     for ( CmdLineArg** opp=options ; *opp ; opp++ ) {
-       CmdLineArg* op = *opp;
-       if ( strcmp( op->flag() , argvp[0] ) == 0 ) {
-	 const char **p = argvp;
-	 const char* empty = "";
-	 if (argcnt < op->numArgs())
-	   //	   error( op->flag() );
-	   p = &empty;
+     CmdLineArg* op = flagIndex(options).find(argvp[0]);
+     if ( op ) {
+       const char **p = argvp;
+       const char* empty = "";
+       if (argcnt < op->numArgs())
+	 //	   error( op->flag() );
+	 p = &empty;
+       try {
 	 op->action( argcnt, p );
-	 argcnt-=op->numArgs(); argvp+=op->numArgs();
-	 ok=1;
+       } catch (CmdLineFailure& failure) {
+	 if ( fatal )
+	   exit(failure.status);
+	 ret=0;
 	 break;
        }
-     }
-     if ( !ok ) {
+       argcnt-=op->numArgs(); argvp+=op->numArgs();
+     } else {
        error("unrecognized command-line option");
        ret=0;
+       if ( !fatal )
+	 break;
      }
    }
    // deal with default arguments (no ``-'')
@@ -1525,6 +1984,125 @@ CmdLineArgs::process(const int          argc,
  return ret;
 } /* CmdLineArg::process */
 
+//
+// query a feature and print the result, as done after setting it
+//
+static void
+printQuery(const Feature* feature)
+{
+ OStringStream os; 
+ {
+   CTraceSpan span(feature->name,"query");
+   feature->query(os); 
+ }
+ CTraceSpan span("output","format");
+ os << ends;
+ cout << os.rdbuf() << '\n'; 
+} /* printQuery */
+
+//
+// with -txn, settings are not applied as their flags are read but
+// collected here and applied together by applyPending() once the whole
+// command line has been processed.
+//
+struct PendingSet {
+  const Feature* feature;
+  CDSList<String> args;
+};
+
+static CDSList<PendingSet*> pending;
+
+// settings which lock or unlock others: these are written first
+static const char* applyFirst[] = { "battery save mode", 0 };
+
+static int
+isApplyFirst(const Feature* feature)
+{
+ for (const char** n=applyFirst ; *n ; n++)
+   if ( strcmp(feature->name,*n)==0 )
+     return 1;
+ return 0;
+} /* isApplyFirst */
+
+// applies every pending setting; returns how many of those from index
+// first on were written, and in numUnchanged how many were already in
+// effect (settings overridden later count as neither)
+static int
+applyPending(int first=0, int* numUnchanged=0)
+{
+ int num = pending.size();
+ int* skip = new int[num+1];
+
+ // read: drop settings overridden later on the command line, and those
+ // already in effect
+ CDSList<const Feature*> seen;
+ for (int i=num-1 ; i>=0 ; i--) {
+   skip[i] = seen.contains(pending[i]->feature);
+   if ( !skip[i] )
+     seen.append(pending[i]->feature);
+ }
+ for (int i=0 ; i<num ; i++) {
+   if ( skip[i] ) continue;
+   CTraceSpan span(pending[i]->feature->name,"unchanged");
+   const char* p[8];
+   for (int j=0 ; j<pending[i]->args.size() && j<8 ; j++)
+     p[j] = pending[i]->args[j];
+   skip[i] = pending[i]->feature->unchanged(p) ? 2 : 0;
+   if ( skip[i] && verbose )
+     cerr << pending[i]->feature->name << ": unchanged, not set\n";
+ }
+
+ // write
+ for (int pass=0 ; pass<2 ; pass++)
+   for (int i=0 ; i<num ; i++) {
+     if ( skip[i] || isApplyFirst(pending[i]->feature)!=(pass==0) ) continue;
+     CTraceSpan span(pending[i]->feature->name,"action");
+     const char* p[8];
+     for (int j=0 ; j<pending[i]->args.size() && j<8 ; j++)
+       p[j] = pending[i]->args[j];
+     pending[i]->feature->action( p );
+   }
+
+ // verify
+ if ( !fast )
+   for (int i=0 ; i<num ; i++)
+     if ( skip[i]!=1 )
+       printQuery(pending[i]->feature);
+
+ int numWritten=0;
+ if ( numUnchanged )
+   *numUnchanged = 0;
+ for (int i=0 ; i<num ; i++) {
+   if ( i>=first ) {
+     numWritten += skip[i]==0;
+     if ( numUnchanged )
+       *numUnchanged += skip[i]==2;
+   }
+   delete pending[i];
+ }
+ pending.resize(0);
+ delete [] skip;
+ return numWritten;
+} /* applyPending */
+
+// forgets the pending settings from index first on, unapplied
+static void
+dropPending(int first)
+{
+ for (int i=first ; i<pending.size() ; i++)
+   delete pending[i];
+ pending.resize(first);
+} /* dropPending */
+
+// -q, -watch and -snapshot read settings back: with -txn, write the ones
+// pending first, so that they see what the command line asked for
+static void
+flushPending()
+{
+ if ( pending.size() )
+   applyPending();
+} /* flushPending */
+
 template<int args>
 class ArgSet : public CmdLineArg {
   const char* flag_;
@@ -1557,17 +2135,40 @@ public:
        }
        //cout << "arg[" << j << "]: " << p[j] << ' ' << strlen(p[j]) << '\n';
      }
-     feature->action( p ); 
-     if ( !fast ) {
-       OStringStream os; 
-       feature->query(os); 
-       os << ends;
-       cout << os.rdbuf() << '\n'; 
+     if ( txn && !feature->local() ) {
+       PendingSet* set = new PendingSet;
+       set->feature = feature;
+       for (int j=0 ; j<args ; j++)
+	 set->args.append( p[j] );
+       pending.setBlockSize(pending.size()+1);  // grow by doubling
+       pending.append(set);
+       return;
      }
+     {
+       CTraceSpan span(feature->name,"action");
+       feature->action( p ); 
+     }
+     if ( !fast )
+       printQuery(feature);
     }
   const char* name() const { return feature->name; }
 };
 
+// let a transport which can fetch registers together read those of
+// features[which[...]] now
+static void
+prefetch(const CDSList<Feature*>& features, const CDSList<int>& which)
+{
+ if ( !transportHas(TRANSPORT_BATCH) )
+   return;
+ CDSList<unsigned short> regs;
+ for (int j=0 ; j<which.size() ; j++)
+   if ( features[which[j]]->sciRegister()>=0 )
+     regs.append(features[which[j]]->sciRegister());
+ if ( regs.size() )
+   transport->sciPrefetch(&regs[0],regs.size());
+} /* prefetch */
+
 class ArgQuery : public CmdLineArg {
   const char* flag_;
   const char* usage_;
@@ -1583,65 +2184,758 @@ public:
     options(options) {}
   const char* flag() const    { return flag_; }
   int         numArgs() const { return numArgs_; }
+  int         argsTaken(int left) const { return left ? 1 : 0; }
   const char* usage() const   { return usage_; }
   void        action(const int&   numArgs,
 		     const char** a      );
+  void        records(const CDSList<int>&  matched,
+			const QueryResult* results) const;
 };
 
-//change: query should return a list of strings (or streams) which ArgQuery 
-// formats for output
-
 void
 ArgQuery::action(const int&   numArgs,
 		 const char** a      ) 
 {
+ flushPending();
+
  String glob = "*";
  if (numArgs == 0) {
-   cout << versionString;
+   if ( outputFormat==OUTPUT_TEXT )
+     cout << versionString;
    numArgs_=0;
  } else {
    glob = String("*") + a[1] + "*";
    numArgs_=1;
  }
 
- int cnt=0;
- for (int i=0 ; i<features.size() ; i++) {
-   OStringStream os;
-   if ( wildmat(features[i]->name , glob,1) ) {
-     int ret = features[i]->query(os);
-     if ( ret==0 ) {
-       cout.setf(ios::left);
-       os << ends;
-       const char* str = os.str();
-       if ( longQuery ) {
-	 const char* flag = "";
-	 for (CmdLineArg** cl=options ; *cl ; cl++)
-	   if ( features[i]->name == (*cl)->name() ) 
-	     flag = (*cl)->flag();
-	 cout << ' ' << setw(10) << flag << " "
-	      << setw(38) << (str?str:"") << '\n';
-       } else {
-	 cout << ' ' << setfill(' ') <<setw(38)<< (str?str:"");
-	 if ( cnt%2==1 )
-	   cout << '\n';
-       }
-       cnt++;
+ CDSList<int> matched;
+ for (int i=0 ; i<features.size() ; i++)
+   if ( wildmat(features[i]->name , glob,1) )
+     matched.append(i);
+
+ prefetch(features,matched);
+
+ // read everything, then format it: the BIOS calls run back to back, and
+ // only what is printed as text is formatted at all
+ QueryResult* results = new QueryResult[matched.size()+1];
+ for (int j=0 ; j<matched.size() ; j++) {
+   const Feature* f = features[matched[j]];
+   CTraceSpan span(f->name,"query");
+   f->read(results[j]);
+ }
+
+ if ( outputFormat!=OUTPUT_TEXT )
+   records(matched,results);
+ else {
+   CTraceSpan span("output","format");
+   cout.setf(ios::left);
+   int cnt=0;
+   for (int j=0 ; j<matched.size() ; j++) {
+     const Feature* f = features[matched[j]];
+     if ( results[j].status ) {
+       if ( verbose )
+	 cerr << "error when querying feature: " << f->name << ": "
+	      << f->error(results[j].status) << '\n';
+       continue;
      }
-     if ( ret && verbose )
-       cerr << "error when querying feature: " << features[i]->name << ": "
-	    << features[i]->error(ret) << '\n';
+     OStringStream os;
+     f->format(results[j],os);
+     os << ends;
+     const char* str = os.str();
+     if ( longQuery ) {
+       const char* flag = flagIndex(options).flagFor(f->name);
+       cout << ' ' << setw(10) << flag << " "
+	    << setw(38) << (str?str:"") << '\n';
+     } else {
+       cout << ' ' << setfill(' ') <<setw(38)<< (str?str:"");
+       if ( cnt%2==1 )
+	 cout << '\n';
+     }
+     cnt++;
    }
+   if ( !longQuery && cnt%2==1 )
+     cout << '\n';
  }
- if ( !longQuery && cnt%2==1 )
-   cout << '\n';
+ delete [] results;
 } /* ArgQuery::action */
 
+// -o json|bin: a record for every matching feature, failed reads
+// included, encoded into one buffer and written at once
+void
+ArgQuery::records(const CDSList<int>&  matched,
+		  const QueryResult* results) const
+{
+ recordBegin(outputFormat);
+ for (int j=0 ; j<matched.size() ; j++) {
+   const Feature* f = features[matched[j]];
+   const QueryResult& res = results[j];
+   QueryRecord r;
+   memset(&r,0,sizeof(r));
+   r.name = f->name;
+   r.flag = flagIndex(options).flagFor(f->name);
+   if ( !*r.flag )
+     r.flag = 0;
+   r.iface = res.iface;
+   r.ebx = res.ebx;
+   r.ecx = res.ecx;
+   r.edx = res.edx;
+   r.status = res.status;
+   r.code = res.code;
+   r.valueLen = -1;
+   if ( r.status ) {
+     r.error = f->error(r.status);
+     recordPut(&r);
+     continue;
+   }
+   if ( (r.value=f->valueName(r.code)) ) {
+     recordPut(&r);
+     continue;
+   }
+
+   // no name for the reading: the formatted text after "name: "
+   OStringStream os;
+   f->format(res,os);
+   os << ends;
+   const char* str = os.str();
+   const char* colon = str ? strstr(str,": ") : 0;
+   r.value = colon ? colon+2 : (str?str:"");
+   while ( *r.value==' ' )
+     r.value++;
+   r.valueLen = strlen(r.value);
+   while ( r.valueLen>0 && (r.value[r.valueLen-1]==' ' ||
+			    r.value[r.valueLen-1]=='\n') )
+     r.valueLen--;
+   recordPut(&r);
+ }
+ size_t len;
+ const char* data = recordData(&len);
+ cout.write(data,len);
+ cout.flush();
+} /* ArgQuery::records */
+
+//
+// -profile name: the options listed under [name] in the profile file are
+// collected as with -txn and applied together, so only settings which
+// differ from the current ones are written.
+//
+class ArgProfile : public CmdLineArg {
+  CmdLineArg** options;
+public:
+  ArgProfile(CmdLineArg** options) : options(options) {}
+  const char* flag() const    { return "-profile"; }
+  int         numArgs() const { return 1; }
+  const char* usage() const   
+    { return "<name> apply the named profile from ~/.toshsetrc"; }
+  void        action(const int&   numArgs,
+		     const char** a      );
+};
+
+void
+ArgProfile::action(const int&   numArgs,
+		   const char** a      )
+{
+ const char* file = profileFile();
+ int num;
+ const char** toks;
+ {
+   CTraceSpan span("load profile","profile");
+   toks = profileFind(file,a[1],&num);
+ }
+ if ( !toks ) 
+   throw CmdLineFailure(1);
+
+ // check every option first, so that a bad profile changes nothing.
+ // Settings only: a query or the like would write those pending early
+ for (int i=0 ; i<num ; ) {
+   CmdLineArg* op = flagIndex(options).find(toks[i]);
+   if ( !op || !*op->name() ) {
+     cerr << file << ": [" << a[1] << "]: invalid option " << toks[i] << '\n';
+     throw CmdLineFailure(2);
+   }
+   i += 1 + op->argsTaken(num-i-1);
+ }
+
+ int saveTxn = txn;
+ int first = pending.size();
+ txn = 1;
+ for (int i=0 ; i<num ; ) {
+   CmdLineArg* op = flagIndex(options).find(toks[i]);
+   int left = num-i-1;
+   op->action( left, toks+i );
+   i += 1 + op->argsTaken(left);
+ }
+ txn = saveTxn;
+
+ int settings = pending.size()-first;
+ int numUnchanged;
+ int numWritten = applyPending(first,&numUnchanged);
+ cout << "profile " << a[1] << ": " << settings << " settings, " 
+      << numUnchanged << " unchanged, " 
+      << numWritten << " written\n";
+} /* ArgProfile::action */
+
+//
+// -batch file: run every line of file (stdin for -) as a toshset command
+// line, all in this one process, against the interface opened at start.
+// Lines are split as in profiles, so quotes and # comments work. BIOS
+// reads are cached from one command to the next until something is
+// written (see smmCache.c). Each command's output, stdout and stderr
+// together, is printed as one record:
+//
+//   == 2: -c quiet -q cool
+//   cooling method: quiet
+//   cooling method: quiet
+//   == 2: ok
+//
+// Toggles such as -v and -fast, and -txn, last for their own line.
+//
+#define BATCH_MAX_ARGS 256
+
+class ArgBatch : public CmdLineArg {
+  const char*  path;
+  CmdLineArg** options;
+  int          running;
+  int          run(int n, int argc, const char** argv);
+public:
+  ArgBatch(const char* path, CmdLineArg** options) :
+    path(path), options(options), running(0) {}
+  const char* flag() const    { return "-batch"; }
+  int         numArgs() const { return 1; }
+  const char* usage() const   
+    { return "<file|-> run each line of file as a toshset command line"; }
+  void        action(const int&   numArgs,
+		     const char** a      );
+};
+
+// run one command line, returning whether it parsed
+int
+ArgBatch::run(int n, int argc, const char** argv)
+{
+ int saveVerbose=verbose, saveLong=longQuery, saveFast=fast, saveTxn=txn;
+ int saveFormat=outputFormat;
+ CDSList<int> early;
+ findEarlyFlags(argc,argv,options,early);
+ for (int j=0 ; j<early.size() ; j++) {
+   int i = early[j];
+   if ( strcmp(argv[i],"-txn")==0 )
+     txn = 1;
+   else if ( strcmp(argv[i],"-o")==0 && i+1<argc &&
+	     outputFormatFor(argv[i+1])>=0 )
+     outputFormat = outputFormatFor(argv[i+1]);
+ }
+
+ stringbuf rec;
+ streambuf* out = cout.rdbuf(&rec);
+ streambuf* err = cerr.rdbuf(&rec);
+ int ok;
+ {
+   CTraceSpan span("command","batch");
+   CmdLineArgs args(path,options,0);
+   ok = args.process(argc,argv);
+   if ( pending.size() )
+     applyPending();
+ }
+ cout.rdbuf(out);
+ cerr.rdbuf(err);
+
+ // text queries end with a NUL: not wanted inside a record. Binary
+ // records are passed on as they are.
+ string text = rec.str();
+ if ( outputFormat!=OUTPUT_BIN ) {
+   text.erase(remove(text.begin(),text.end(),'\0'),text.end());
+   if ( text.size() && text[text.size()-1]!='\n' )
+     text += '\n';
+ }
+ cout << "== " << n << ':';
+ for (int i=1 ; i<argc ; i++)
+   cout << ' ' << argv[i];
+ cout << '\n' << text << "== " << n << ": " << (ok?"ok":"error") << endl;
+
+ verbose=saveVerbose; longQuery=saveLong; fast=saveFast; txn=saveTxn;
+ outputFormat=saveFormat;
+ return ok;
+} /* ArgBatch::run */
+
+void
+ArgBatch::action(const int&   numArgs,
+		 const char** a      )
+{
+ if ( running ) {
+   cerr << "-batch: batches do not nest\n";
+   throw CmdLineFailure(2);
+ }
+ if ( numArgs<1 || !*a[1] ) {
+   cerr << "-batch: file name required\n";
+   throw CmdLineFailure(2);
+ }
+ FILE* in = strcmp(a[1],"-")==0 ? stdin : fopen(a[1],"r");
+ if ( !in ) {
+   cerr << a[1] << ": " << strerror(errno) << '\n';
+   throw CmdLineFailure(1);
+ }
+
+ running = 1;
+ smmCacheEnabled = 1;
+ char* line=0;
+ size_t size=0;
+ int n=0;
+ while ( getline(&line,&size,in)>=0 ) {
+   const char* argv[BATCH_MAX_ARGS+1];
+   int num = profileSplit(line,argv+1,BATCH_MAX_ARGS);
+   if ( num==0 )                 // blank, or only a comment
+     continue;
+   argv[0] = path;
+   batchFailed += !run(++n,num+1,argv);
+ }
+ smmCacheFlush();
+ smmCacheEnabled = 0;
+ running = 0;
+
+ free(line);
+ if ( in!=stdin )
+   fclose(in);
+} /* ArgBatch::action */
+
+//
+// -snapshot file: save every setting toshset can set back (those with an
+// option and a list of values) to an image, see snapshot.c. -restore
+// file: apply an image taken on the same model and BIOS version, as with
+// -txn, so only settings which differ are written.
+//
+class ArgSnapshot : public CmdLineArg {
+  CDSList<Feature*> features;
+  CmdLineArg**      options;
+public:
+  ArgSnapshot(const CDSList<Feature*>& features, CmdLineArg** options) :
+    features(features), options(options) {}
+  const char* flag() const    { return "-snapshot"; }
+  int         numArgs() const { return 1; }
+  const char* usage() const   
+    { return "<file> save all settings to a snapshot image"; }
+  void        action(const int&   numArgs,
+		     const char** a      );
+};
+
+void
+ArgSnapshot::action(const int&   numArgs,
+		    const char** a      )
+{
+ if ( numArgs<1 || !*a[1] ) {
+   cerr << "-snapshot: file name required\n";
+   throw CmdLineFailure(2);
+ }
+ flushPending();
+
+ CDSList<int> settable;
+ for (int i=0 ; i<features.size() ; i++)
+   if ( !features[i]->local() && features[i]->valueArg(0) &&
+	*flagIndex(options).flagFor(features[i]->name) &&
+	strlen(features[i]->name)<SNAPSHOT_NAME_LEN )
+     settable.append(i);
+ prefetch(features,settable);
+
+ SnapshotEntry* entries = new SnapshotEntry[settable.size()+1];
+ int n=0;
+ for (int j=0 ; j<settable.size() ; j++) {
+   const Feature* f = features[settable[j]];
+   QueryResult r;
+   {
+     CTraceSpan span(f->name,"query");
+     f->read(r);
+   }
+   if ( r.status || r.code<0 )     // not supported here
+     continue;
+   SnapshotEntry* e = &entries[n++];
+   memset(e,0,sizeof(*e));
+   e->iface = r.iface;
+   e->ebx = r.ebx;
+   e->code = r.code;
+   e->ecx = r.ecx;
+   strcpy(e->name,f->name);
+ }
+
+ int failed = snapshotWrite(a[1],id,bios,entries,n);
+ delete [] entries;
+ if ( failed )
+   throw CmdLineFailure(1);
+ cout << "snapshot " << a[1] << ": " << n << " settings\n";
+} /* ArgSnapshot::action */
+
+// the argument which selects setting number code of f, in buf if need
+// be: its name, unless an earlier setting has the same name (battery save
+// mode has two "full"s), else its number; 0 if neither selects it
+static const char*
+settingArg(const Feature* f, int code, char* buf, int size)
+{
+ const char* arg = f->valueArg(code);
+ int i=0;
+ while ( strcmp(f->valueArg(i),arg)!=0 )
+   i++;
+ if ( i==code )
+   return arg;
+ snprintf(buf,size,"%d",code);
+ for (i=0 ; f->valueArg(i) ; i++)
+   if ( strcmp(f->valueArg(i),buf)==0 )
+     return 0;
+ return buf;
+} /* settingArg */
+
+class ArgRestore : public CmdLineArg {
+  CDSList<Feature*> features;
+public:
+  ArgRestore(const CDSList<Feature*>& features) : features(features) {}
+  const char* flag() const    { return "-restore"; }
+  int         numArgs() const { return 1; }
+  const char* usage() const   
+    { return "<file> apply the settings of a snapshot image"; }
+  void        action(const int&   numArgs,
+		     const char** a      );
+};
+
+void
+ArgRestore::action(const int&   numArgs,
+		   const char** a      )
+{
+ if ( numArgs<1 || !*a[1] ) {
+   cerr << "-restore: file name required\n";
+   throw CmdLineFailure(2);
+ }
+
+ // everything which can be checked without reading the entries first
+ Snapshot snap;
+ if ( snapshotOpen(&snap,a[1]) )
+   throw CmdLineFailure(1);
+ const SnapshotHeader* h = snap.header;
+ if ( (int)h->machineId!=id || (int)h->biosVersion!=bios ) {
+   char buf[160];
+   snprintf(buf,sizeof(buf),"%s: snapshot of machine id 0x%04x BIOS %d.%d, "
+	    "this is machine id 0x%04x BIOS %d.%d\n",a[1],
+	    h->machineId,(h->biosVersion & 0xff00)>>8,h->biosVersion & 0xff,
+	    id,(bios & 0xff00)>>8,bios & 0xff);
+   cerr << buf;
+   snapshotClose(&snap);
+   throw CmdLineFailure(1);
+ }
+ if ( snapshotVerify(&snap) ) {
+   cerr << a[1] << ": snapshot checksum does not match\n";
+   snapshotClose(&snap);
+   throw CmdLineFailure(1);
+ }
+
+ CDSList<int> which;
+ int first = pending.size();
+ for (unsigned int k=0 ; k<h->count ; k++) {
+   const SnapshotEntry* e = &snap.entries[k];
+   String name(e->name,strnlen(e->name,sizeof(e->name)));
+   int i=0;
+   if ( memchr(e->name,0,sizeof(e->name)) )
+     for ( ; i<features.size() ; i++)
+       if ( strcmp(features[i]->name,e->name)==0 )
+	 break;
+   if ( i==features.size() || !features[i]->valueArg(e->code) ) {
+     cerr << a[1] << ": entry " << k << " (" << name 
+	  << ") not known, skipped\n";
+     continue;
+   }
+   if ( !features[i]->isValue(e->code,e->ecx) ) {
+     char buf[64];
+     snprintf(buf,sizeof(buf),"0x%04x",e->ecx);
+     cerr << a[1] << ": entry " << k << " (" << name << "): setting "
+	  << e->code << " and register value " << buf << " disagree\n";
+     dropPending(first);
+     snapshotClose(&snap);
+     throw CmdLineFailure(1);
+   }
+   char buf[16];
+   const char* arg = settingArg(features[i],e->code,buf,sizeof(buf));
+   if ( !arg ) {
+     cerr << a[1] << ": entry " << k << " (" << name 
+	  << "): setting " << e->code << " cannot be selected, skipped\n";
+     continue;
+   }
+   PendingSet* set = new PendingSet;
+   set->feature = features[i];
+   set->args.append( arg );
+   pending.setBlockSize(pending.size()+1);
+   pending.append(set);
+   which.append(i);
+ }
+ snapshotClose(&snap);
+
+ prefetch(features,which);
+ int settings = pending.size()-first;
+ int numUnchanged;
+ int numWritten = applyPending(first,&numUnchanged);
+ cout << "restore " << a[1] << ": " << settings << " settings, " 
+      << numUnchanged << " unchanged, " 
+      << numWritten << " written\n";
+} /* ArgRestore::action */
+
+//
+// -watch glob: keep querying the matching features, each on its own
+// timer, and print a line whenever a value changes. A feature's interval
+// starts at -interval ms; it stretches by half while the value holds, up
+// to WATCH_MAX_FACTOR times that, and drops back to the base interval as
+// soon as the value changes. Runs until interrupted.
+//
+#define WATCH_MAX_FACTOR 16
+
+static volatile sig_atomic_t watchStop=0;
+
+static void
+watchSignal(int)
+{
+ watchStop = 1;
+} /* watchSignal */
+
+class ArgWatch : public CmdLineArg {
+  CDSList<Feature*> features;
+public:
+  ArgWatch(const CDSList<Feature*>& features) : features(features) {}
+  const char* flag() const    { return "-watch"; }
+  int         numArgs() const { return 1; }
+  const char* usage() const   
+    { return "<glob> print changes of matching features (see -interval)"; }
+  void        action(const int&   numArgs,
+		     const char** a      );
+};
+
+struct Watched {
+  const Feature* feature;
+  int            fd;
+  long           intervalMs;
+  QueryResult    last;
+};
+
+static void
+watchArm(Watched* w)
+{
+ struct itimerspec its;
+ its.it_value.tv_sec  = its.it_interval.tv_sec  = w->intervalMs / 1000;
+ its.it_value.tv_nsec = its.it_interval.tv_nsec = 
+   (w->intervalMs % 1000) * 1000000L;
+ timerfd_settime(w->fd,0,&its,0);
+} /* watchArm */
+
+// read w's feature; return 1 if the value differs from the last one.
+// Readings are compared as read: only a change is formatted.
+static int
+watchSample(Watched* w)
+{
+ QueryResult r;
+ if ( w->feature->read(r) )
+   return 0;
+ if ( r == w->last )
+   return 0;
+ w->last = r;
+ return 1;
+} /* watchSample */
+
+static void
+watchPrint(const Watched* w)
+{
+ struct timespec now;
+ OStringStream os;
+ w->feature->format(w->last,os);
+ os << ends;
+ const char* str = os.str();
+ clock_gettime(CLOCK_REALTIME,&now);
+ printf("%ld.%03ld %s\n",(long)now.tv_sec,now.tv_nsec/1000000L,
+	str?str:"");
+ fflush(stdout);
+} /* watchPrint */
+
+void
+ArgWatch::action(const int&   numArgs,
+		 const char** a      )
+{
+ String glob = String("*") + (numArgs>0 ? a[1] : "") + "*";
+ CDSList<Watched*> watched;
+
+ flushPending();
+
+ // changes are the point: don't answer from -batch's read cache
+ smmCacheEnabled = 0;
+
+ for (int i=0 ; i<features.size() ; i++) {
+   if ( !wildmat(features[i]->name,glob,1) )
+     continue;
+   Watched* w = new Watched;
+   w->feature = features[i];
+   w->intervalMs = watchInterval;
+   w->last.status = -1;             // no reading yet: the first one differs
+   if ( !watchSample(w) ) {        // not supported here: leave it out
+     delete w;
+     continue;
+   }
+   if ( (w->fd=timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC))<0 ) {
+     cerr << "timerfd_create: " << strerror(errno) << '\n';
+     delete w;
+     for (int j=0 ; j<watched.size() ; j++) {
+       close(watched[j]->fd);
+       delete watched[j];
+     }
+     throw CmdLineFailure(1);
+   }
+   watchPrint(w);
+   watchArm(w);
+   watched.append(w);
+ }
+ if ( !watched.size() ) {
+   cerr << "-watch: no feature matching " << (numArgs>0 ? a[1] : "") 
+	<< '\n';
+   throw CmdLineFailure(1);
+ }
+
+ struct sigaction sa;
+ memset(&sa,0,sizeof(sa));
+ sa.sa_handler = watchSignal;
+ sigaction(SIGINT,&sa,0);
+ sigaction(SIGTERM,&sa,0);
+
+ struct pollfd* fds = new struct pollfd[watched.size()];
+ for (int i=0 ; i<watched.size() ; i++) {
+   fds[i].fd = watched[i]->fd;
+   fds[i].events = POLLIN;
+ }
+ while ( !watchStop ) {
+   if ( poll(fds,watched.size(),-1)<0 ) 
+     continue;                     // EINTR: check watchStop
+   for (int i=0 ; i<watched.size() ; i++) {
+     if ( !(fds[i].revents & POLLIN) )
+       continue;
+     Watched* w = watched[i];
+     unsigned long long expirations;
+     if ( ::read(w->fd,&expirations,sizeof(expirations))<0 )
+       continue;
+     long next;
+     if ( watchSample(w) ) {
+       watchPrint(w);
+       next = watchInterval;
+     } else {
+       next = w->intervalMs + w->intervalMs/2;
+       if ( next > watchInterval*WATCH_MAX_FACTOR )
+	 next = watchInterval*WATCH_MAX_FACTOR;
+     }
+     if ( next!=w->intervalMs ) {
+       w->intervalMs = next;
+       watchArm(w);
+     }
+   }
+ }
+
+ delete [] fds;
+ for (int i=0 ; i<watched.size() ; i++) {
+   close(watched[i]->fd);
+   delete watched[i];
+ }
+} /* ArgWatch::action */
+
+static int statsFormat=STATS_TEXT;
+
+//
+// -stats, -trace, -txn, -interval and -o are picked up by main() before
+// the command line is processed, so that the startup probes and every
+// other flag are covered wherever they appear; here they just consume
+// their argument.
+//
+class ArgEarly : public CmdLineArg {
+  const char* flag_;
+  const char* usage_;
+  int numArgs_;
+public:
+  ArgEarly(const char* flag,
+	   const char* usage,
+		 int   numArgs) :
+    flag_(flag), usage_(usage), numArgs_(numArgs) {}
+  const char* flag() const    { return flag_; }
+  int         numArgs() const { return numArgs_; }
+  const char* usage() const   { return usage_; }
+  void        action(const int&, const char**) {}
+  int         early() const   { return 1; }
+};
+
+// -stats and -trace have to be on for the startup probes, which run
+// before the option list exists: any argument which looks like one of
+// them starts collecting, and setEarlyFlags() keeps or drops that once
+// the command line can be walked properly. Nothing is written before
+// exit, so a -trace which turns out to be an argument touches no file.
+static void
+scanEarlyFlags(int argc, const char* argv[])
+{
+ for (int i=1 ; i<argc ; i++)
+   if ( strcmp(argv[i],"-stats")==0 )
+     smmStatsEnabled = 1;
+   else if ( strcmp(argv[i],"-trace")==0 && i+1<argc ) {
+     if ( ctraceOpen(argv[i+1]) )
+       exit(1);
+   }
+} /* scanEarlyFlags */
+
+static void
+setEarlyFlags(int argc, const char* argv[], CmdLineArg** options)
+{
+ CDSList<int> early;
+ int stats=0;
+ const char* trace=0;
+
+ findEarlyFlags(argc,argv,options,early);
+ for (int j=0 ; j<early.size() ; j++) {
+   int i = early[j];
+   if ( strcmp(argv[i],"-stats")==0 ) {
+     if ( i+1>=argc || (strcmp(argv[i+1],"text") && 
+			strcmp(argv[i+1],"csv")) ) {
+       cerr << "-stats: format must be text or csv\n";
+       exit(2);
+     }
+     stats = 1;
+     statsFormat = strcmp(argv[i+1],"csv")==0 ? STATS_CSV : STATS_TEXT;
+   } else if ( strcmp(argv[i],"-trace")==0 && i+1<argc )
+     trace = argv[i+1];
+   else if ( strcmp(argv[i],"-txn")==0 )
+     txn = 1;
+   else if ( strcmp(argv[i],"-o")==0 ) {
+     if ( i+1>=argc || (outputFormat=outputFormatFor(argv[i+1]))<0 ) {
+       cerr << "-o: format must be text, json or bin\n";
+       exit(2);
+     }
+   } else if ( strcmp(argv[i],"-interval")==0 && i+1<argc ) {
+     watchInterval = atoi(argv[i+1]);
+     if ( watchInterval<=0 ) {
+       cerr << "-interval: must be a positive number of milliseconds\n";
+       exit(2);
+     }
+   }
+ }
+ smmStatsEnabled = stats;
+ if ( trace )
+   ctraceOpen(trace);
+ else if ( ctraceEnabled )
+   ctraceCancel();
+} /* setEarlyFlags */
+
+static void
+cerrMessage(const char* text)
+{
+ cerr << text;
+} /* cerrMessage */
+
+// give a list feature its settings, from the table shared with
+// toshset-fleet
+template<class F>
+static void
+addValues(F& feature)
+{
+ for (const SettingValue* v=settingValues ; v->feature ; v++)
+   if ( strcmp(v->feature,feature.name)==0 )
+     feature.addValue(v->input,v->code,v->output);
+} /* addValues */
 
 int 
 main(      int   argc, 
      const char* argv[])
 {
- int version,bios;
+ int version;
 
 // if (ioperm(0xb2, 1, 1)) {
 //   cerr << argv[0] << ": can't get I/O permissions.\n" 
@@ -1649,6 +2943,19 @@ main(      int   argc,
 //   return 1;
 // }
 
+ // comparing two recorded traces needs no hardware at all
+ if ( argc==4 && strcmp(argv[1],"-tracediff")==0 )
+   return smmTraceDiff(argv[2],argv[3]);
+
+ // messages from the C modules go through cerr too, so that -batch
+ // keeps them in the record of the command which caused them
+ snapshotMessage = profileMessage = cerrMessage;
+
+ scanEarlyFlags(argc,argv);
+
+ if ( ctraceEnabled )
+   ctraceBegin("startup","startup");
+
  // should be use /dev/toshiba or direct calls to the BIOS
  detAccessMode();
 
@@ -1681,7 +2988,8 @@ main(      int   argc,
  }
 
 
- if ( checkToshibaID(id) )
+ // the sysfs driver has no machine id to give
+ if ( checkToshibaID(id) || transport==&sysfsTransport )
    snprintf(versionString,80,
 	    " machine id: 0x%04x    BIOS version:"
 	    " %d.%d    SCI version: %d.%d\n", id,
@@ -1704,6 +3012,8 @@ main(      int   argc,
  /* check to see if a copy of wmTuxTime is already running */
  
  SciOpenInterface();
+ if ( ctraceEnabled )
+   ctraceEnd();
 
  CDSList<Feature*> features;
 
@@ -1721,62 +3031,37 @@ main(      int   argc,
  features.append(&accessFeature);
 
  SciFeature batteryFeature(SCI_BATTERY_SAVE,"battery save mode");
- batteryFeature.addValue( "user"   , SCI_USER_SETTINGS , "user settings");
- batteryFeature.addValue( "full"   , SCI_FULL_POWER    , "full power");
- batteryFeature.addValue( "low"    , SCI_LOW_POWER     , "low power");
- batteryFeature.addValue( "economy", SCI_ECONOMY       , "economy settings");
- batteryFeature.addValue( "normal" , SCI_NORMAL_LIFE   , "normal life");
- batteryFeature.addValue( "long"   , SCI_LONG_LIFE     , "long life");
- batteryFeature.addValue( "full"   , SCI_FULL_LIFE     , "full life");
+ addValues(batteryFeature);
  features.append(&batteryFeature);
 
  HciFeature acFeature(HCI_AC_ADAPTOR,"power source");
- acFeature.addValue( ""   , 3   , "battery" );
- acFeature.addValue( ""   , 4   , "external" );
+ addValues(acFeature);
  features.append(&acFeature);
 
  HciFeature backlightFeature(HCI_BACKLIGHT,"LCD backlight");
- backlightFeature.addValue( "off"  , HCI_DISABLE   , "off" );
- backlightFeature.addValue( "on"   , HCI_ENABLE   , "on" );
+ addValues(backlightFeature);
  features.append(&backlightFeature);
 
  HciFeature trBacklightFeature(HCI_TR_BACKLIGHT,"transreflective mode");
- trBacklightFeature.addValue( "off"  , HCI_ENABLE   , "off" );
- trBacklightFeature.addValue( "on"   , HCI_DISABLE   , "on" );
+ addValues(trBacklightFeature);
  features.append(&trBacklightFeature);
 
  HciFeature fanFeature(HCI_FAN,"fan");
- fanFeature.addValue( "off"  , HCI_DISABLE   , "off" );
- fanFeature.addValue( "on"   , HCI_ENABLE   , "on" );
- fanFeature.addValue( "fan1" , HCI_FAN_FAN1  , "fan1" );
- fanFeature.addValue( "fan2" , HCI_FAN_FAN2  , "fan2" );
- fanFeature.addValue( "1/4" , HCI_FAN_LOW2  , "1/4" );
- fanFeature.addValue( "3/4" , HCI_FAN_HIGH2  , "3/4" );
- fanFeature.addValue( "2/4"  , HCI_FAN_LOW3   , "2/4" );
- fanFeature.addValue( "high1" , HCI_FAN_HIGH1  , "high1" );
- fanFeature.addValue( "high" , HCI_FAN_HIGH  , "high" );
- fanFeature.addValue( "low" , HCI_FAN_LOW  , "low" );
- fanFeature.addValue( "1/8" , HCI_FAN_LOW4  , "1/8" );
+ addValues(fanFeature);
  features.append(&fanFeature);
 
  HciFeature selectBayFeature(HCI_SELECT_STATUS,"select bay");
  // fanFeature.addValue( "on"   , HCI_ENABLE   , "on" );
- selectBayFeature.addValue( ""  , HCI_NOTHING  , "empty" );
- selectBayFeature.addValue( ""  , HCI_FLOPPY   , "floppy" );
- selectBayFeature.addValue( ""  , HCI_ATAPI    , "CDROM" );
- selectBayFeature.addValue( ""  , HCI_IDE      , "hard disk" );
- selectBayFeature.addValue( ""  , HCI_BATTERY  , "battery" );
+ addValues(selectBayFeature);
  features.append(&selectBayFeature);
 
  HciFeature selectBayLockFeature(HCI_LOCK_STATUS,"select bay lock");
  // fanFeature.addValue( "on"   , HCI_ENABLE   , "on" );
- selectBayLockFeature.addValue( "engage"  , HCI_LOCKED   , "engaged" );
- selectBayLockFeature.addValue( "dis"     , HCI_UNLOCKED , "disabled" );
+ addValues(selectBayLockFeature);
  features.append(&selectBayLockFeature);
 
  SciFeature irFeature(SCI_INFRARED_PORT,"IR port");
- irFeature.addValue( "off"  , SCI_OFF   , "off" );
- irFeature.addValue( "on"   , SCI_ON    , "on" );
+ addValues(irFeature);
  features.append(&irFeature);
 
 // HciFeature firFeature(HCI_FIR_STATUS,"HCI IR port");
@@ -1785,39 +3070,47 @@ main(      int   argc,
 // features.append(&firFeature);
 
  SciFeature legacyUSBFeature(SCI_USB_LEGACY_MODE, "USB legacy mode");
- legacyUSBFeature.addValue("disable" , SCI_DISABLED , "disabled");
- legacyUSBFeature.addValue("enable"  , SCI_ENABLED , "enabled");
+ addValues(legacyUSBFeature);
  features.append(&legacyUSBFeature);
 
  SciFeature USBFDDFeature(SCI_USB_FDD_EMULAT, "USB FDD emulation mode");
- USBFDDFeature.addValue("disable" , SCI_DISABLED , "disabled");
- USBFDDFeature.addValue("enable"  , SCI_ENABLED , "enabled");
+ addValues(USBFDDFeature);
  features.append(&USBFDDFeature);
 
  SciFeature LANcontrollerFeature(SCI_LAN_CONTROLLER, "LAN controller");
- LANcontrollerFeature.addValue("disable" , SCI_DISABLED , "disabled");
- LANcontrollerFeature.addValue("enable"  , SCI_ENABLED , "enabled");
+ addValues(LANcontrollerFeature);
  features.append(&LANcontrollerFeature);
 
  SciFeature soundlogoFeature(SCI_SOUND_LOGO, "sound logo");
- soundlogoFeature.addValue("disable" , SCI_DISABLED , "disabled");
- soundlogoFeature.addValue("enable"  , SCI_ENABLED , "enabled");
+ addValues(soundlogoFeature);
  features.append(&soundlogoFeature);
 
  SciFeature startuplogoFeature(SCI_STARTUP_LOGO, "startup logo");
- startuplogoFeature.addValue("picture" , SCI_PICTURE_LOGO , "picture");
- startuplogoFeature.addValue("animation"  , SCI_ANIMATION_LOGO , "animation");
+ addValues(startuplogoFeature);
  features.append(&startuplogoFeature);
 
+ SciFeature illuminationFeature(SCI_ILLUMINATION, "illumination");
+ addValues(illuminationFeature);
+ features.append(&illuminationFeature);
+
+ SciFeature trackpadFeature(SCI_TRACKPAD, "trackpad");
+ addValues(trackpadFeature);
+ features.append(&trackpadFeature);
+
+ SciFeature fastBootFeature(SCI_FAST_BOOT, "fast boot");
+ addValues(fastBootFeature);
+ features.append(&fastBootFeature);
+
+ SciFeature sleepMusicFeature(SCI_SLEEP_MUSIC, "sleep and music");
+ addValues(sleepMusicFeature);
+ features.append(&sleepMusicFeature);
+
+ SciFeature kbdLightFeature(SCI_KBD_BACKLIGHT, "keyboard backlight");
+ addValues(kbdLightFeature);
+ features.append(&kbdLightFeature);
+
  HciFeature videoFeature(HCI_VIDEO_OUT,"Video out");
- videoFeature.addValue("int" ,HCI_INTERNAL , "internal: LCD" );
- videoFeature.addValue("ext" ,HCI_EXTERNAL , "external monitor" );
- videoFeature.addValue("both",HCI_SIMULTANEOUS , 
-		       "internal and external monitor");
- videoFeature.addValue("tv",HCI_TVOUT , "tv out");
- videoFeature.addValue("mode5", 0x105 , "mode5 ??");
- videoFeature.addValue("mode6", 0x106 , "mode6 ??");
- videoFeature.addValue("mode7", 0x107 , "mode7 ??");
+ addValues(videoFeature);
  features.append(&videoFeature);
 
  int supportsHibernation = 1;
@@ -1849,87 +3142,59 @@ main(      int   argc,
  features.append(&fpanelFeature);
 
  SciFeature beepFeature(SCI_SYSTEM_BEEP,"system beep");
- beepFeature.addValue( "off"  , SCI_OFF  , "off" );
- beepFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(beepFeature);
  features.append(&beepFeature);
 
  SciFeature lcdFeature(SCI_LCD_BRIGHTNESS,"lcd brightness");
- lcdFeature.addValue("semi"   , SCI_SEMI_BRIGHT  , "semi-bright" );
- lcdFeature.addValue("bright" , SCI_BRIGHT       , "bright" );
- lcdFeature.addValue("super"  , SCI_SUPER_BRIGHT , "super-bright" );
+ addValues(lcdFeature);
  features.append(&lcdFeature);
 
  LCDIntensityFeature intensityFeature("lcd intensity");
  features.append(&intensityFeature);
 
  SciFeature processingFeature(SCI_PROCESSING,"CPU speed");
- processingFeature.addValue("slow" , SCI_LOW  , "slow" );
- processingFeature.addValue("fast" , SCI_HIGH  , "fast" );
+ addValues(processingFeature);
  features.append(&processingFeature);
 
  SciFeature sleepFeature(SCI_SLEEP_MODE,"CPU sleep mode");
- sleepFeature.addValue( "off"  , SCI_OFF  , "off" );
- sleepFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(sleepFeature);
  features.append(&sleepFeature);
 
  SciFeature dstretchFeature(SCI_SLEEP_MODE,"Display stretch");
- dstretchFeature.addValue( "off"  , SCI_OFF  , "off" );
- dstretchFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(dstretchFeature);
  features.append(&dstretchFeature);
 
  SciFeature cpuCacheFeature(SCI_CPU_CACHE,"CPU cache");
- cpuCacheFeature.addValue( "off"  , SCI_OFF  , "off" );
- cpuCacheFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(cpuCacheFeature);
  features.append(&cpuCacheFeature);
 
  //????
  SciFeature cachePolicyFeature(SCI_CACHE_POLICY,"cache policy");
- cachePolicyFeature.addValue( "write-back"    , 0 , "write back" );
- cachePolicyFeature.addValue( "write-through" , 1 , "write through" );
+ addValues(cachePolicyFeature);
  features.append(&cachePolicyFeature);
 
  SciFeature volumeFeature(SCI_SPEAKER_VOLUME,"speaker volume");
- volumeFeature.addValue( "off"    , SCI_VOLUME_OFF    , "off"    );
- volumeFeature.addValue( "low"    , SCI_VOLUME_LOW    , "low"    );
- volumeFeature.addValue( "medium" , SCI_VOLUME_MEDIUM , "medium" );
- volumeFeature.addValue( "high"   , SCI_VOLUME_HIGH   , "high"   );
+ addValues(volumeFeature);
  features.append(&volumeFeature);
 
  SciFeature batAlarmFeature(SCI_BATTERY_ALARM,"battery alarm");
- batAlarmFeature.addValue( "off"  , SCI_OFF  , "off" );
- batAlarmFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(batAlarmFeature);
  features.append(&batAlarmFeature);
 
  SciFeature panAlarmFeature(SCI_PANEL_ALARM,"panel alarm");
- panAlarmFeature.addValue( "off"  , SCI_OFF  , "off" );
- panAlarmFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(panAlarmFeature);
  features.append(&panAlarmFeature);
 
  SciFeature panPowerFeature(SCI_PANEL_POWER,"panel power");
- panPowerFeature.addValue( "off"  , SCI_OFF  , "off" );
- panPowerFeature.addValue( "on"   , SCI_ON   , "on" );
+ addValues(panPowerFeature);
  features.append(&panPowerFeature);
 
  SciFeature hddFeature(SCI_HDD_AUTO_OFF,"hard disk auto-off time");
- hddFeature.addValue( "dis" , SCI_TIME_DISABLED , "disabled");
- hddFeature.addValue( "1"   , SCI_TIME_01 , "1 minute");
- hddFeature.addValue( "3"   , SCI_TIME_03 , "3 minutes");
- hddFeature.addValue( "5"   , SCI_TIME_05 , "5 minutes");
- hddFeature.addValue( "10"  , SCI_TIME_10 , "10 minutes");
- hddFeature.addValue( "15"  , SCI_TIME_15 , "15 minutes");
- hddFeature.addValue( "20"  , SCI_TIME_20 , "20 minutes");
- hddFeature.addValue( "30"  , SCI_TIME_30 , "30 minutes");
+ addValues(hddFeature);
  features.append(&hddFeature);
 
  SciFeature displayFeature(SCI_DISPLAY_AUTO,"display auto-off time");
- displayFeature.addValue( "dis" , SCI_TIME_DISABLED , "disabled");
- displayFeature.addValue( "1"   , SCI_TIME_01 , "1 minute");
- displayFeature.addValue( "3"   , SCI_TIME_03 , "3 minutes");
- displayFeature.addValue( "5"   , SCI_TIME_05 , "5 minutes");
- displayFeature.addValue( "10"  , SCI_TIME_10 , "10 minutes");
- displayFeature.addValue( "15"  , SCI_TIME_15 , "15 minutes");
- displayFeature.addValue( "20"  , SCI_TIME_20 , "20 minutes");
- displayFeature.addValue( "30"  , SCI_TIME_30 , "30 minutes");
+ addValues(displayFeature);
  features.append(&displayFeature);
 
 // HciFeature hciPowerFeature(HCI_POWER_UP,"HCI power-up mode");
@@ -1940,10 +3205,7 @@ main(      int   argc,
 // features.append(&hciPowerFeature);
 
  SciFeature sciPowerFeature(SCI_POWER_UP,"power-up mode");
- sciPowerFeature.addValue( "boot"      , SCI_BOOT         	  , "boot");
- sciPowerFeature.addValue( "resume"    , SCI_RESUME       	  , "resume");
- sciPowerFeature.addValue( "hibernate" , SCI_HIBERNATE    	  , "hibernate");
- sciPowerFeature.addValue( "quick"     , SCI_QUICK_HIBERNATE , "quick-hibernate");
+ addValues(sciPowerFeature);
  features.append(&sciPowerFeature);
 
  PercentFeature batteryPercentFeature(SCI_BATTERY_PERCENT,"battery percent");
@@ -1960,9 +3222,7 @@ main(      int   argc,
 // features.append(&secBatFeature);
 
  SciFeature coolingFeature(SCI_COOLING_METHOD,"cooling method");
- coolingFeature.addValue( "perform"   , SCI_PERFORMANCE	  , "performance");
- coolingFeature.addValue( "quiet"     , SCI_QUIET  	  , "quiet");
- coolingFeature.addValue( "other"     , 2      	          , "other");
+ addValues(coolingFeature);
  features.append(&coolingFeature);
 
  TimeFeature wakeAlarmFeature(SCI_ALARM_POWER,"power-up alarm");
@@ -1971,20 +3231,12 @@ main(      int   argc,
  features.append(&wakeAlarmFeature);
 
  SciFeature autoOffFeature(SCI_SYSTEM_AUTO,"auto-off time");
- autoOffFeature.addValue( "dis" , SCI_TIME_DISABLED , "disabled");
- autoOffFeature.addValue( "10"  , SCI_TIME_10 , " 10 minutes");
- autoOffFeature.addValue( "20"  , SCI_TIME_20 , " 20 minutes");
- autoOffFeature.addValue( "30"  , SCI_TIME_30 , " 30 minutes");
- autoOffFeature.addValue( "40"  , SCI_TIME_40 , " 40 minutes");
- autoOffFeature.addValue( "50"  , SCI_TIME_50 , " 50 minutes");
- autoOffFeature.addValue( "60"  , SCI_TIME_60 , " 60 minutes");
+ addValues(autoOffFeature);
 
  features.append(&autoOffFeature);
 
  SciFeature parallelFeature(SCI_PARALLEL_PORT,"parallel port mode");
- parallelFeature.addValue( "ecp" ,SCI_PARALLEL_ECP, "ecp" );
- parallelFeature.addValue( "spp" ,SCI_PARALLEL_SPP, "spp" );
- parallelFeature.addValue( "ps2" ,SCI_PARALLEL_PS2, "ps2" );
+ addValues(parallelFeature);
  // parallelFeature.addValue
  features.append(&parallelFeature);
 
@@ -1993,31 +3245,21 @@ main(      int   argc,
  features.append(&standbyFeature);
 
  SciFeature hibernationFeature(SCI_HIBERNATION,"Hibernation");
- hibernationFeature.addValue("disable" , 0 , "not configured");
- hibernationFeature.addValue("enable"  , 1 , "configured");
+ addValues(hibernationFeature);
  features.append(&hibernationFeature);
 
  // I don't know what this option does, but the following values seem to 
  // be valid on my 8100
  SciFeature pointerFeature(SCI_POINTING_DEVICE,"Pointer");
- pointerFeature.addValue("0" , 0 , "0");
- pointerFeature.addValue("1"  , 1 , "1");
- pointerFeature.addValue("2"  , 2 , "2");
- pointerFeature.addValue("3"  , 3 , "3");
+ addValues(pointerFeature);
  features.append(&pointerFeature);
 
  SciFeature bootFeature(SCI_BOOT_METHOD,"boot method");
- bootFeature.addValue( "fdhdcd" , SCI_FD_HD , "floppy->hard disk->CDROM");
- bootFeature.addValue( "hdfdcd" , SCI_HD_FD , "hard disk->floppy->CDROM");
- bootFeature.addValue( "fdcdhd" , 2         , "floppy->CDROM->hard disk");
- bootFeature.addValue( "hdcdfd" , 3         , "hard disk->CDROM->floppy");
- bootFeature.addValue( "cdfdhd" , 4         , "CDROM->floppy->hard disk");
- bootFeature.addValue( "cdhdfd" , 5         , "CDROM->hard disk->floppy");
+ addValues(bootFeature);
  features.append(&bootFeature);
 
  HciFeature wirelessFeature(HCI_WIRELESS,"wireless support");
- wirelessFeature.addValue( "" , 0 , "not present");
- wirelessFeature.addValue( "" , 0xf , "present");
+ addValues(wirelessFeature);
  features.append(&wirelessFeature);
 
  WirelessFeature wirelessSwitchFeature(0x1, "wireless switch");
@@ -2091,16 +3333,40 @@ main(      int   argc,
    new ArgSet<1>("-lan","<enable|disable> LAN controller",&LANcontrollerFeature),
    new ArgSet<1>("-soundlogo","<enable|disable> sound logo",&soundlogoFeature),
    new ArgSet<1>("-startlogo","<picture|animation> startup logo mode",&soundlogoFeature),
+   new ArgSet<1>("-illum","<on|off> illumination LEDs",&illuminationFeature),
+   new ArgSet<1>("-trackpad","<enable|disable> trackpad",&trackpadFeature),
+   new ArgSet<1>("-fastboot","<on|off> fast boot",&fastBootFeature),
+   new ArgSet<1>("-sleepmusic","<on|off> USB sleep and music",
+		 &sleepMusicFeature),
+   new ArgSet<1>("-kbdlight","<off|on|auto> keyboard backlight",
+		 &kbdLightFeature),
    new ArgQuery("-q",
 		"[glob] query option matching glob (or all if no arg)",
 		features,argList),
    new ArgSet<0>("-v","toggle verbose mode",&verboseFeature),
    new ArgSet<0>("-l","toggle long query",&longFeature),
    new ArgSet<0>("-fast","skip checks, run faster",&fastFeature),
+   new ArgEarly("-stats",
+		"<text|csv> print per-register BIOS call statistics at exit",1),
+   new ArgEarly("-trace",
+		"<file> write a Chrome trace-event timeline of the run",1),
+   new ArgProfile(argList),
+   new ArgWatch(features),
+   new ArgBatch(argv[0],argList),
+   new ArgSnapshot(features,argList),
+   new ArgRestore(features),
+   new ArgEarly("-interval",
+		"<ms> base sampling interval for -watch (1000)",1),
+   new ArgEarly("-txn",
+		"apply all settings together, skipping unchanged ones",0),
+   new ArgEarly("-o",
+		"<text|json|bin> -q output: columns, JSON lines or records",1),
    0 };
 
  CmdLineArgs args( argv[0], argList );
 
+ setEarlyFlags(argc,argv,argList);
+
  if ( argc<2 ) {
    args.usage();
    return 1;
@@ -2108,9 +3374,15 @@ main(      int   argc,
    if ( !args.process(argc,argv) )
      return 1;
 
+ if ( pending.size() )
+   applyPending();
+
  SciCloseInterface();
 
- return 0;
+ if ( smmStatsEnabled )
+   smmStatsDump(stderr,statsFormat);
+
+ return batchFailed ? 1 : 0;
 }
 
 #if __GNUG__
@@ -0,0 +1,23 @@
+/* transport.c -- the selected BIOS access backend
+ *
+ * The direct backend lives in direct.c, which is linked from direct32.c
+ * or direct64.c depending on the architecture, so its table is kept
+ * here. The other backends define theirs next to their code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "transport.h"
+#include "direct.h"
+
+const Transport directTransport = {
+  "direct", 0,
+  dHciFunction, dHciGetBiosVersion, dHciGetMachineID,
+  dSciSupportCheck, dSciOpenInterface, dSciCloseInterface,
+  dSciGet, dSciSet, 0
+};
+
+const Transport* transport = &directTransport;
@@ -0,0 +1,60 @@
+
+#ifndef __transport_h__
+#define __transport_h__
+
+/*
+  the ways of reaching the BIOS. detAccessMode() picks one backend at
+startup and points transport at it; sci.c and hci.c then call through it
+without caring which it is. Each backend fills in every operation, and
+says in caps what else it can do, so that callers can pick a faster path
+where there is one.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef USE_KERNEL_INTERFACE
+#  include<linux/toshiba.h>
+#else
+#  include "smm.h"
+#endif
+
+enum {
+  TRANSPORT_BATCH       = 0x01,  /* sciPrefetch reads several at once */
+  TRANSPORT_ASYNC       = 0x02,  /* calls can complete asynchronously */
+  TRANSPORT_BULK_STRING = 0x04,  /* owner string in one transfer */
+  TRANSPORT_NO_WAIT     = 0x08   /* answers are canned: never sleep on busy */
+};
+
+typedef struct {
+  const char*  name;
+  unsigned int caps;
+  int (*hciFunction)(SMMRegisters *reg);
+  int (*hciGetBiosVersion)(void);
+  int (*hciGetMachineID)(int *id);
+  int (*sciSupportCheck)(int *version);
+  int (*sciOpenInterface)(void);
+  int (*sciCloseInterface)(void);
+  int (*sciGet)(SMMRegisters *reg);
+  int (*sciSet)(SMMRegisters *reg);
+  // with TRANSPORT_BATCH: fetch these registers together ahead of the
+  // sciGet calls that ask for them
+  void (*sciPrefetch)(const unsigned short* ebx, int n);
+} Transport;
+
+extern const Transport* transport;
+
+extern const Transport directTransport;
+extern const Transport kernelTransport;
+extern const Transport emulatorTransport;
+extern const Transport replayTransport;
+extern const Transport sysfsTransport;
+
+#define transportHas(cap) ((transport->caps & (cap))!=0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __transport_h__ */